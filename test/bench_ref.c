@@ -0,0 +1,218 @@
+/**
+ * Benchmark: reference counting.
+ *
+ * Measures the cost of a y_ref/y_unref pair in the common cases: the thread 
+ * that created an object referencing it, a thread-confined object, and several 
+ * threads referencing either their own objects or one shared object (with 
+ * its reference count either single or sharded).  The single-threaded cases 
+ * are also measured with the inline fast paths.  Also compares referencing 
+ * the objects of an array one by one with doing so in bulk.
+ *
+ * Not part of the test suites: run with "make bench".
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <apr_time.h>
+#include <apr_thread_proc.h>
+#include <yakka/Yakka.h>
+#include <yakka/Object-inline.h>
+#include <test/ootest/Alpha.h>
+#include <test/ootest/Epsilon.h>
+#include <test/threads.h>
+
+#define BENCH_ITERATIONS  5000000
+#define BENCH_THREADS     4
+#define BENCH_ARRAY_SIZE  1000
+
+y_Runtime * rt;
+
+void setup ()
+{
+    apr_status_t apr_status;
+
+    apr_status = apr_initialize ();
+    if ( apr_status != APR_SUCCESS )
+        abort ();
+
+    rt = y_Runtime_new (NULL, NULL, 1024, true);
+    assert (rt);
+}
+
+void
+teardown ()
+{
+    y_Runtime_destroy (rt);
+    apr_terminate ();
+}
+
+/*
+ * Reference and unreference an object repeatedly.
+ */
+void
+ref_unref (void * obj, int iterations)
+{
+    int i;
+    for ( i = 0; i < iterations; i++ ) {
+        y_unref (y_ref (obj));
+    }
+}
+
+/*
+ * The same, using the inline fast paths.
+ */
+void
+ref_unref_inline (void * obj, int iterations)
+{
+    int i;
+    for ( i = 0; i < iterations; i++ ) {
+        y_unref_inline (y_ref_inline (obj));
+    }
+}
+
+void
+report (const char * name, apr_time_t start, long pairs)
+{
+    apr_time_t elapsed = apr_time_now () - start;
+    printf ("%-44s %8.2f ns per ref/unref pair\n", name,
+            (elapsed * 1000.0) / pairs);
+}
+
+void
+bench_owner ()
+{
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+    apr_time_t start = apr_time_now ();
+
+    ref_unref (alpha, BENCH_ITERATIONS);
+    report ("Shared object, creating thread", start, BENCH_ITERATIONS);
+    start = apr_time_now ();
+    ref_unref_inline (alpha, BENCH_ITERATIONS);
+    report ("Shared object, creating thread, inline", start,
+            BENCH_ITERATIONS);
+    y_unref (alpha);
+}
+
+void
+bench_confined ()
+{
+    Epsilon * epsilon = Epsilon_new (rt, 1, NULL);
+    apr_time_t start = apr_time_now ();
+
+    ref_unref (epsilon, BENCH_ITERATIONS);
+    report ("Confined object, creating thread", start, BENCH_ITERATIONS);
+    start = apr_time_now ();
+    ref_unref_inline (epsilon, BENCH_ITERATIONS);
+    report ("Confined object, creating thread, inline", start,
+            BENCH_ITERATIONS);
+    y_unref (epsilon);
+}
+
+void * APR_THREAD_FUNC
+own_object_thread (apr_thread_t * thread, void * data)
+{
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+    ref_unref (alpha, BENCH_ITERATIONS);
+    y_unref (alpha);
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void * APR_THREAD_FUNC
+shared_object_thread (apr_thread_t * thread, void * data)
+{
+    ref_unref (((TestThread *)data)->data, BENCH_ITERATIONS);
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void
+bench_threads_own_objects ()
+{
+    apr_time_t start = apr_time_now ();
+
+    run_threads (BENCH_THREADS, own_object_thread, NULL);
+    report ("Shared objects, one per thread", start,
+            (long)BENCH_ITERATIONS * BENCH_THREADS);
+}
+
+void
+bench_threads_one_object ()
+{
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+    apr_time_t start = apr_time_now ();
+
+    run_threads (BENCH_THREADS, shared_object_thread, alpha);
+    report ("Shared object, all threads", start,
+            (long)BENCH_ITERATIONS * BENCH_THREADS);
+    y_unref (alpha);
+}
+
+void
+bench_threads_hot_object ()
+{
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+    apr_time_t start;
+
+    y_make_shared_hot (alpha);
+    start = apr_time_now ();
+    run_threads (BENCH_THREADS, shared_object_thread, alpha);
+    report ("Hot shared object, all threads", start,
+            (long)BENCH_ITERATIONS * BENCH_THREADS);
+    y_unref (alpha);
+}
+
+void
+bench_array ()
+{
+    void * objects[BENCH_ARRAY_SIZE];
+    int rounds = BENCH_ITERATIONS / BENCH_ARRAY_SIZE;
+    apr_time_t start;
+    int i, j;
+
+    for ( i = 0; i < BENCH_ARRAY_SIZE; i++ ) {
+        objects[i] = Alpha_new (rt, i, NULL);
+    }
+
+    start = apr_time_now ();
+    for ( j = 0; j < rounds; j++ ) {
+        for ( i = 0; i < BENCH_ARRAY_SIZE; i++ ) {
+            y_ref (objects[i]);
+        }
+        for ( i = 0; i < BENCH_ARRAY_SIZE; i++ ) {
+            y_unref (objects[i]);
+        }
+    }
+    report ("Array of objects, one by one", start,
+            (long)rounds * BENCH_ARRAY_SIZE);
+
+    start = apr_time_now ();
+    for ( j = 0; j < rounds; j++ ) {
+        y_ref_many (objects, BENCH_ARRAY_SIZE);
+        y_unref_many (objects, BENCH_ARRAY_SIZE);
+    }
+    report ("Array of objects, y_ref_many/y_unref_many", start,
+            (long)rounds * BENCH_ARRAY_SIZE);
+
+    y_unref_many (objects, BENCH_ARRAY_SIZE);
+}
+
+int
+main ()
+{
+    setup ();
+
+    bench_owner ();
+    bench_confined ();
+    bench_threads_own_objects ();
+    bench_threads_one_object ();
+    bench_threads_hot_object ();
+    bench_array ();
+
+    teardown ();
+    return 0;
+}
+
+#undef BENCH_ARRAY_SIZE
+#undef BENCH_THREADS
+#undef BENCH_ITERATIONS
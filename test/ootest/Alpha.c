@@ -1,7 +1,7 @@
 #include "Alpha-protected.h"
 
 static char * alpha_type_name = "Alpha";
-static AlphaClass * alpha_class = NULL;
+static y_TypeSlot alpha_class = 0;
 
 Alpha *
 Alpha_new (y_Runtime * rt, int a,
@@ -12,10 +12,50 @@ Alpha_new (y_Runtime * rt, int a,
     return self;
 }
 
+/**
+ * Setter for a plain value.
+ *
+ * The object is locked while the value is written.  Locking also marks the 
+ * object as being written, so that optimistic readers (see Alpha_get) know to 
+ * retry.  A frozen object cannot be locked for writing, so the setter fails.
+ */
 void
 Alpha_set (Alpha * self, int a, y_Error ** error)
 {
-    self->a = a;
+    Alpha * alpha = ALPHA (self);
+
+    if ( alpha ) {
+        if ( ! y_lock_for_write (alpha) ) {
+            y_Error_throw (y_get_runtime (alpha), error, __FILE__, __LINE__,
+                    APR_EINVAL, "Alpha is frozen");
+            return;
+        }
+        alpha->a = a;
+        y_unlock (alpha);
+    }
+}
+
+/**
+ * Getter for a plain value, using an optimistic read.
+ *
+ * Rather than locking the object, the value is copied and the read is 
+ * repeated if a writer locked the object in the meantime.  The reader never 
+ * writes to the object, so many threads can read it without contention.
+ */
+int
+Alpha_get (Alpha * self)
+{
+    Alpha * alpha = ALPHA (self);
+    unsigned int version;
+    int a = 0;
+
+    if ( alpha ) {
+        do {
+            version = y_read_begin (alpha);
+            a = alpha->a;
+        } while ( y_read_retry (alpha, version) );
+    }
+    return a;
 }
 
 void *
@@ -54,7 +94,8 @@ Alpha_init_type (y_Runtime * rt, void * type, void * super_type)
             sizeof (AlphaProtected),
             NULL,  /* no special init required */
             Alpha_assign,
-            Alpha_clear
+            Alpha_clear,
+            0      /* same thread-safety policy as Object */
             );
 }
 
@@ -26,6 +26,11 @@ Alpha * Alpha_new (y_Runtime * rt, int iota, y_Error ** error);
  */
 void Alpha_set (Alpha * self, int a, y_Error ** error);
 
+/**
+ * Get the value of an Alpha instance (without locking it).
+ */
+int Alpha_get (Alpha * self);
+
 #define ALPHA(self) \
     y_SAFE_CAST_INSTANCE(self, Alpha_type, Alpha)
 
@@ -1,6 +1,8 @@
 #include "Beta.h"
 
-static int beta_id = 0;
+y_DEFINE_INTERFACE (Beta_interface, Beta_name);
+
+static y_InlineCache do_action_cache;
 
 Beta *
 Beta_implement (y_Runtime * rt,
@@ -16,7 +18,8 @@ Beta_implement (y_Runtime * rt,
 int
 Beta_do_action (void * self)
 {
-    Beta * vtable = y_GET_INSTANCE_VTABLE (self, Beta, Beta_name, beta_id);
+    Beta * vtable = y_GET_CACHED_VTABLE (self, Beta, Beta_interface,
+            do_action_cache);
     if ( vtable ) {
         return vtable->do_action (self);
     }
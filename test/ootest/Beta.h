@@ -7,9 +7,14 @@
 /**
  * Example of an interface.
  */
-static char * Beta_name = "Beta";
+#define Beta_name  "Beta"
 static const int Beta_default = 0;
 
+/**
+ * Descriptor of the interface.
+ */
+extern y_InterfaceDesc Beta_interface;
+
 /**
  * Vtable for interface.
  */
@@ -6,7 +6,7 @@
 #endif
 
 static char * delta_type_name = "Delta";
-static DeltaClass * delta_class = NULL;
+static y_TypeSlot delta_class = 0;
 
 typedef struct DeltaPrivate {
     char * d;
@@ -35,14 +35,15 @@ Delta_set (Delta * self, int a, const char * b, Gamma * c, const char * d,
 
 /**
  * Setter for an explicitly managed member variable (in this case a string 
- * using malloc'd memory).  The variable is stored in the protected structure.
+ * using malloc'd memory).  The variable is stored in the protected structure.  
+ * Like all setters, it does nothing if the object is frozen.
  */
 void
 Delta_set_b (void * self, const char * b)
 {
     Delta * delta = DELTA (self);
     DeltaProtected * prot = DELTA_PROTECTED (delta);
-    if ( prot ) {
+    if ( prot && y_lock_for_write (delta) ) {
         if ( prot->b ) {
             free (prot->b);
         }
@@ -54,6 +55,7 @@ Delta_set_b (void * self, const char * b)
             b_copy[len] = '\0';
         }
         prot->b = b_copy;
+        y_unlock (delta);
     }
 }
 
@@ -73,20 +75,36 @@ Delta_get_b (void * self)
 /**
  * Setter for an object reference.
  *
- * The caller creates the reference and passes it.  We do not unref the 
- * reference because we are keeping it.  However if there is an existing 
- * reference, it should be unreffed because it will not be kept.
+ * The caller keeps its own reference, so we acquire one for the member and 
+ * hand it over to the "steal" setter.
  */
 void
 Delta_set_c (void * self, Gamma * c)
+{
+    Delta_set_c_steal (self, y_ref (c));
+}
+
+/**
+ * Setter for an object reference, taking over the caller's reference.
+ *
+ * The caller hands over its reference (typically with y_move), which we keep 
+ * without changing the reference count.  However if there is an existing 
+ * reference, it should be unreffed because it will not be kept.  (If the 
+ * object cannot be set, the reference is released.)
+ */
+void
+Delta_set_c_steal (void * self, Gamma * c)
 {
     Delta * delta = DELTA (self);
     DeltaProtected * prot = DELTA_PROTECTED (delta);
-    if ( prot ) {
-        if ( prot->c ) {
-            y_unref (prot->c);
-        }
-        prot->c = y_ref (c);
+    if ( prot && y_lock_for_write (delta) ) {
+        Gamma * old_c = prot->c;
+        prot->c = c;
+        y_unlock (delta);
+        y_unref (old_c);
+    }
+    else {
+        y_unref (c);
     }
 }
 
@@ -119,7 +137,7 @@ Delta_set_d (void * self, const char * d)
 {
     Delta * delta = DELTA (self);
     DeltaProtected * prot = DELTA_PROTECTED (delta);
-    if ( prot ) {
+    if ( prot && y_lock_for_write (delta) ) {
         DeltaPrivate * priv = prot->priv;
         if ( priv->d ) {
             free (priv->d);
@@ -132,6 +150,7 @@ Delta_set_d (void * self, const char * d)
             d_copy[len] = '\0';
         }
         priv->d = d_copy;
+        y_unlock (delta);
     }
 }
 
@@ -185,7 +204,7 @@ Delta_clear (void * self, bool unref_objects)
     if ( delta ) {
         Delta_set_b (delta, NULL);
         if ( unref_objects ) {
-            Delta_set_c (delta, NULL);            
+            Delta_set_c_steal (delta, NULL);
         }
         Delta_set_d (delta, NULL);
     }
@@ -204,7 +223,8 @@ Delta_init_type (y_Runtime * rt, void * type, void * super_type)
             sizeof (DeltaProtected),
             Delta_init,
             Delta_assign,
-            Delta_clear
+            Delta_clear,
+            0
             );
 }
 
@@ -31,6 +31,8 @@ const char * Delta_get_b (void * self);
 
 void Delta_set_c (void * self, Gamma * c);
 
+void Delta_set_c_steal (void * self, Gamma * c);
+
 Gamma * Delta_get_c (void * self);
 
 void Delta_set_d (void * self, const char * d);
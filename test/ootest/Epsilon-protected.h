@@ -0,0 +1,18 @@
+#ifndef EPSILON_PROTECTED_H_
+#define EPSILON_PROTECTED_H_
+
+#include "Epsilon.h"
+#include "Alpha-protected.h"
+
+typedef struct EpsilonProtected {
+    AlphaProtected      alpha;
+} EpsilonProtected;
+
+#define EPSILON_PROTECTED(self)   \
+    ((EpsilonProtected *)y_OBJECT_PROTECTED (self))
+
+struct EpsilonClass {
+    AlphaClass      alpha;
+};
+
+#endif
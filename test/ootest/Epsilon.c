@@ -0,0 +1,16 @@
+#include "Epsilon-protected.h"
+
+y_DEFINE_CLASS (Epsilon, Alpha,
+        NULL,  /* no special init required */
+        NULL,  /* Alpha's assign is sufficient */
+        NULL,  /* Alpha's clear is sufficient */
+        y_TYPE_CONFINED)
+
+Epsilon *
+Epsilon_new (y_Runtime * rt, int a,
+        y_Error ** error)
+{
+    Epsilon * self = (Epsilon *)y_create (rt, Epsilon_type (rt), error);
+    Alpha_set ((Alpha *)self, a, error);
+    return self;
+}
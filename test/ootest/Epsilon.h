@@ -0,0 +1,31 @@
+#ifndef EPSILON_H_
+#define EPSILON_H_
+
+#include <yakka/Yakka.h>
+#include "Alpha.h"
+
+typedef struct EpsilonClass EpsilonClass;
+
+/**
+ * Example of a thread-confined class: an Epsilon is only ever used by the 
+ * thread that created it, so it has no mutex and its reference count is not 
+ * atomic.
+ */
+typedef struct Epsilon {
+    Alpha       alpha;
+} Epsilon;
+
+/**
+ * Get the class type for Epsilon.
+ */
+EpsilonClass * Epsilon_type (y_Runtime * rt);
+
+/**
+ * Create a new instance of Epsilon.
+ */
+Epsilon * Epsilon_new (y_Runtime * rt, int a, y_Error ** error);
+
+#define EPSILON(self) \
+    y_SAFE_CAST_INSTANCE(self, Epsilon_type, Epsilon)
+
+#endif
@@ -2,7 +2,7 @@
 #include "Beta.h"
 
 static char * gamma_type_name = "Gamma";
-static GammaClass * gamma_class = NULL;
+static y_TypeSlot gamma_class = 0;
 
 int Beta_do_action_impl (void * self);
 
@@ -26,10 +26,9 @@ Gamma_init_type (y_Runtime * rt, void * type, void * super_type)
             sizeof (GammaProtected),
             NULL,
             NULL,
-            NULL
+            NULL,
+            0
             );
-    y_ObjectClass * object_type = (y_ObjectClass *)type;
-
     Beta * beta_impl = Beta_implement (rt,
         Beta_do_action_impl
         );
@@ -37,7 +36,7 @@ Gamma_init_type (y_Runtime * rt, void * type, void * super_type)
         { Beta_name, beta_impl},
         { NULL, }
     };
-    object_type->interfaces = y_Runtime_pack_interfaces (rt, interface_specs);
+    y_implement_interfaces (rt, type, interface_specs);
 }
 
 int
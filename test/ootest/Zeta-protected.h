@@ -0,0 +1,18 @@
+#ifndef ZETA_PROTECTED_H_
+#define ZETA_PROTECTED_H_
+
+#include "Zeta.h"
+#include "Gamma-protected.h"
+
+typedef struct ZetaProtected {
+    GammaProtected      gamma;
+} ZetaProtected;
+
+#define ZETA_PROTECTED(self)   \
+    ((ZetaProtected *)y_OBJECT_PROTECTED (self))
+
+struct ZetaClass {
+    GammaClass      gamma;
+};
+
+#endif
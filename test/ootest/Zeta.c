@@ -0,0 +1,25 @@
+#include "Zeta-protected.h"
+#include "Beta.h"
+
+int Zeta_do_action (void * self);
+
+static const Beta zeta_beta = {
+    Zeta_do_action
+};
+
+/* Overrides Gamma's implementation of Beta; final */
+y_DEFINE_CLASS (Zeta, Gamma, NULL, NULL, NULL, y_TYPE_FINAL,
+        { &Beta_interface, &zeta_beta })
+
+Zeta *
+Zeta_new (y_Runtime * rt, y_Error ** error)
+{
+    Zeta * self = (Zeta *)y_create (rt, Zeta_type (rt), error);
+    return self;
+}
+
+int
+Zeta_do_action (void * self)
+{
+    return Zeta_default;
+}
@@ -0,0 +1,32 @@
+#ifndef ZETA_H_
+#define ZETA_H_
+
+#include <yakka/Yakka.h>
+#include "Gamma.h"
+
+static const int Zeta_default = 7;
+
+typedef struct ZetaClass ZetaClass;
+
+/**
+ * Example of a class that overrides an interface implemented by its super 
+ * class (Beta, implemented by Gamma).  It is final: it may not be subclassed.
+ */
+typedef struct Zeta {
+    Gamma       gamma;
+} Zeta;
+
+/**
+ * Get the class type for Zeta.
+ */
+ZetaClass * Zeta_type (y_Runtime * rt);
+
+/**
+ * Create a new instance of Zeta.
+ */
+Zeta * Zeta_new (y_Runtime * rt, y_Error ** error);
+
+#define ZETA(self) \
+    y_SAFE_CAST_INSTANCE(self, Zeta_type, Zeta)
+
+#endif
@@ -1,13 +1,24 @@
+#define y_INSTRUMENT_INLINE_CACHES
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <apr_strings.h>
+#include <apr_thread_proc.h>
 #include <yakka/Yakka.h>
+#include <yakka/Object-inline.h>
 #include "ootest/Alpha.h"
 #include "ootest/Beta.h"
 #include "ootest/Gamma.h"
+#include "ootest/Zeta.h"
+#include "threads.h"
 
 y_Runtime * rt;
 
+y_DEFINE_INTERFACE (foo_interface, "foo");
+y_DEFINE_INTERFACE (qux_interface, "qux");
+y_DEFINE_INTERFACE (quux_interface, "quux");
+y_DEFINE_INTERFACE (corge_interface, "corge");
+
 void setup ()
 {
     apr_status_t apr_status;
@@ -68,6 +79,11 @@ test_interface_get_implementation ()
     assert ( y_get_implementation (gamma, iface_id) ==
             y_get_implementation_by_name (gamma, Beta_name) );
 
+    /* The inline fast path agrees */
+    assert ( ! y_get_implementation_inline (alpha, iface_id) );
+    assert ( y_get_implementation_inline (gamma, iface_id) ==
+            y_get_implementation (gamma, iface_id) );
+
     y_unref (alpha);
     y_unref (gamma);
 }
@@ -92,6 +108,305 @@ test_interface_use ()
     y_unref (gamma);
 }
 
+void
+test_interface_packing ()
+{
+    printf ("Test packing implementations of many interfaces (%d)\n",
+            __LINE__);
+
+    apr_pool_t * pool = y_Runtime_get_global_pool (rt);
+    char * names[200];
+    int vtables[3];
+    int i;
+
+    /* Register many interfaces (the runtime keeps their names); the class 
+     * implements three of them */
+    for ( i = 0; i < 200; i++ ) {
+        names[i] = apr_psprintf (pool, "iface%d", i);
+        y_Runtime_get_interface_id (rt, names[i]);
+    }
+    y_InterfaceSpec specs[] = {
+        { names[3], &vtables[0] },
+        { names[130], &vtables[1] },
+        { names[199], &vtables[2] },
+        { NULL, }
+    };
+    y_Interfaces * interfaces = y_Runtime_pack_interfaces (rt, specs);
+
+    /* The table only grows with the interfaces implemented */
+    assert (interfaces->size == 3);
+    assert (interfaces->mask + 1 <= 8);
+
+    assert (y_Interfaces_lookup (interfaces,
+                y_Runtime_get_interface_id (rt, names[3])) == &vtables[0]);
+    assert (y_Interfaces_lookup (interfaces,
+                y_Runtime_get_interface_id (rt, names[130])) == &vtables[1]);
+    assert (y_Interfaces_lookup (interfaces,
+                y_Runtime_get_interface_id (rt, names[199])) == &vtables[2]);
+    for ( i = 0; i < 200; i++ ) {
+        if ( i != 3 && i != 130 && i != 199 ) {
+            assert (! y_Interfaces_lookup (interfaces,
+                        y_Runtime_get_interface_id (rt, names[i])));
+        }
+    }
+    assert (! y_Interfaces_lookup (interfaces, 0));
+    assert (! y_Interfaces_lookup (NULL, 1));
+}
+
+void
+test_interface_descriptor ()
+{
+    printf ("Test registering interfaces by descriptor (%d)\n", __LINE__);
+
+    Gamma * gamma = Gamma_new (rt, NULL);
+    int next_id = y_Runtime_get_interface_id (rt, "next") + 1;
+
+    /* The module's descriptors: those already known keep their identifiers, 
+     * the others get consecutive ones */
+    y_REGISTER_INTERFACES (rt);
+#ifdef y_HAVE_INTERFACE_SECTION
+    assert (y_Runtime_find_interface (rt, &foo_interface) ==
+            y_Runtime_get_interface_id (rt, "foo"));
+    assert (y_Runtime_find_interface (rt, &qux_interface) >= next_id);
+    assert (y_Runtime_find_interface (rt, &quux_interface) >= next_id);
+    assert (y_Runtime_find_interface (rt, &corge_interface) >= next_id);
+    assert (y_Runtime_find_interface (rt, &qux_interface) +
+            y_Runtime_find_interface (rt, &quux_interface) +
+            y_Runtime_find_interface (rt, &corge_interface) ==
+            3 * next_id + 3);
+#endif /* y_HAVE_INTERFACE_SECTION */
+
+    /* Otherwise, registered on first use */
+    assert (y_get_implementation_of (gamma, &Beta_interface) ==
+            y_get_implementation_by_name (gamma, Beta_name));
+    assert (y_Runtime_find_interface (rt, &Beta_interface) ==
+            y_Runtime_get_interface_id (rt, Beta_name));
+    assert (! y_get_implementation_of (gamma, &qux_interface));
+    assert (y_Runtime_register_interface (rt, &qux_interface) ==
+            y_Runtime_get_interface_id (rt, "qux"));
+
+    y_unref (gamma);
+}
+
+void
+test_interface_inheritance ()
+{
+    printf ("Test inheriting and overriding interfaces (%d)\n", __LINE__);
+
+    Gamma * gamma = Gamma_new (rt, NULL);
+    Zeta * zeta = Zeta_new (rt, NULL);
+    int beta_id = y_Runtime_get_interface_id (rt, Beta_name);
+    int foo_id = y_Runtime_get_interface_id (rt, "foo");
+    int foo_vtable;
+
+    /* Zeta overrides Gamma's implementation */
+    assert (Beta_do_action (gamma) == Gamma_default);
+    assert (Beta_do_action (zeta) == Zeta_default);
+    assert (y_get_implementation (zeta, beta_id) !=
+            y_get_implementation (gamma, beta_id));
+
+    /* A class adding an interface keeps those of its super class */
+    y_InterfaceSpec specs[] = {
+        { "foo", &foo_vtable },
+        { NULL, }
+    };
+    y_Interfaces * interfaces = y_Runtime_merge_interfaces (rt,
+            TYPE_AS_OBJECT (gamma)->interfaces, specs);
+    assert (interfaces->size == 2);
+    assert (y_Interfaces_lookup (interfaces, beta_id) ==
+            y_get_implementation (gamma, beta_id));
+    assert (y_Interfaces_lookup (interfaces, foo_id) == &foo_vtable);
+
+    y_unref (gamma);
+    y_unref (zeta);
+}
+
+static y_InlineCache beta_cache;
+
+Beta *
+get_cached_beta (void * self)
+{
+    return y_GET_CACHED_VTABLE (self, Beta, Beta_interface, beta_cache);
+}
+
+void
+test_interface_inline_cache ()
+{
+    printf ("Test retrieving implementations through an inline cache (%d)\n",
+            __LINE__);
+
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+    Gamma * gamma = Gamma_new (rt, NULL);
+    Zeta * zeta = Zeta_new (rt, NULL);
+    int beta_id = y_Runtime_get_interface_id (rt, Beta_name);
+
+    /* Monomorphic: the first class is looked up once */
+    assert (get_cached_beta (gamma) == y_get_implementation (gamma, beta_id));
+    assert (get_cached_beta (gamma) == y_get_implementation (gamma, beta_id));
+    assert (get_cached_beta (gamma) == y_get_implementation (gamma, beta_id));
+    assert (atomic_load (&(beta_cache.misses)) == 1);
+    assert (atomic_load (&(beta_cache.hits)) == 2);
+
+    /* Polymorphic: other classes are remembered too, even without an 
+     * implementation */
+    assert (get_cached_beta (zeta) == y_get_implementation (zeta, beta_id));
+    assert (get_cached_beta (zeta) == y_get_implementation (zeta, beta_id));
+    assert (! get_cached_beta (alpha));
+    assert (! get_cached_beta (alpha));
+    assert (! get_cached_beta (NULL));
+    assert (atomic_load (&(beta_cache.misses)) == 3);
+    assert (atomic_load (&(beta_cache.hits)) == 4);
+    assert (atomic_load (&(beta_cache.rt)) == rt);
+
+    y_unref (alpha);
+    y_unref (gamma);
+    y_unref (zeta);
+}
+
+void
+test_interface_ref ()
+{
+    printf ("Test calling methods through an interface reference (%d)\n",
+            __LINE__);
+
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+    Gamma * gamma = Gamma_new (rt, NULL);
+    Zeta * zeta = Zeta_new (rt, NULL);
+    y_WeakRef * weak_ref = y_weak_ref (gamma);
+    y_IfaceRef beta = y_IFACE_REF_INIT;
+
+    assert (! y_IfaceRef_is_set (beta));
+    beta = y_as_interface (gamma, &Beta_interface);
+    assert (y_IfaceRef_is_set (beta));
+    assert (beta.obj == gamma);
+    assert (beta.vtable == y_get_implementation_of (gamma, &Beta_interface));
+    assert (y_IFACE_VTABLE (beta, Beta)->do_action (beta.obj) ==
+            Gamma_default);
+
+    beta = y_as_interface (zeta, &Beta_interface);
+    assert (y_IFACE_VTABLE (beta, Beta)->do_action (beta.obj) ==
+            Zeta_default);
+
+    /* Not implemented */
+    assert (! y_IfaceRef_is_set (y_as_interface (alpha, &Beta_interface)));
+    assert (! y_IfaceRef_is_set (y_as_interface (NULL, &Beta_interface)));
+
+    /* The reference keeps the object */
+    beta = y_IfaceRef_ref (y_as_interface (gamma, &Beta_interface));
+    y_unref (gamma);
+    assert (y_WeakRef_is_set (weak_ref));
+    y_IfaceRef_unref (&beta);
+    assert (! y_IfaceRef_is_set (beta));
+    assert (! y_WeakRef_is_set (weak_ref));
+
+    y_unref (weak_ref);
+    y_unref (alpha);
+    y_unref (zeta);
+}
+
+void
+test_interface_runtimes ()
+{
+    printf ("Test interface descriptors in several runtimes (%d)\n",
+            __LINE__);
+
+    y_Runtime * other_rt = y_Runtime_new (NULL, NULL, 16, true);
+    Gamma * gamma = Gamma_new (rt, NULL);
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+    int i;
+
+    /* Registered in another order: the identifiers differ */
+    assert (y_Runtime_register_interface (other_rt, &corge_interface) == 1);
+    Gamma * other_gamma = Gamma_new (other_rt, NULL);
+    Alpha * other_alpha = Alpha_new (other_rt, 1, NULL);
+    assert (y_Runtime_get_interface_id (other_rt, Beta_name) !=
+            y_Runtime_get_interface_id (rt, Beta_name));
+
+    /* The descriptor resolves in whichever runtime it is used with */
+    for ( i = 0; i < 2; i++ ) {
+        assert (y_get_implementation_of (gamma, &Beta_interface) ==
+                y_get_implementation_by_name (gamma, Beta_name));
+        assert (y_get_implementation_of (other_gamma, &Beta_interface) ==
+                y_get_implementation_by_name (other_gamma, Beta_name));
+        assert (Beta_do_action (gamma) == Gamma_default);
+        assert (Beta_do_action (other_gamma) == Gamma_default);
+        assert (! y_get_implementation_of (other_alpha, &Beta_interface));
+        assert (! y_get_implementation_of (alpha, &corge_interface));
+    }
+
+    /* Each runtime keeps its own identifier for the descriptor */
+    assert (y_Runtime_find_interface (rt, &Beta_interface) ==
+            y_Runtime_get_interface_id (rt, Beta_name));
+    assert (y_Runtime_find_interface (other_rt, &Beta_interface) ==
+            y_Runtime_get_interface_id (other_rt, Beta_name));
+    assert (y_Runtime_find_interface (other_rt, &quux_interface) == 0);
+
+    y_unref (other_alpha);
+    y_unref (other_gamma);
+    y_Runtime_destroy (other_rt);
+
+    assert (y_get_implementation_of (gamma, &Beta_interface) ==
+            y_get_implementation_by_name (gamma, Beta_name));
+    y_unref (alpha);
+    y_unref (gamma);
+}
+
+#define REGISTRY_THREADS  4
+#define REGISTRY_NAMES    300
+
+/*
+ * Register the same interface names as the other threads, each in a 
+ * different order, recording their identifiers.
+ */
+void * APR_THREAD_FUNC
+register_thread (apr_thread_t * thread, void * data)
+{
+    TestThread * test_thread = (TestThread *)data;
+    int * ids = ((int (*)[REGISTRY_NAMES])test_thread->data)[
+        test_thread->index];
+    int offset = test_thread->index * 13;  /* where to start */
+    char name[32];
+    int i;
+
+    for ( i = 0; i < REGISTRY_NAMES; i++ ) {
+        int n = (i * 7 + offset) % REGISTRY_NAMES;
+        sprintf (name, "shared%d", n);
+        ids[n] = y_Runtime_get_interface_id (rt, name);
+        /* Visible to this thread from then on, without locking */
+        assert (y_Runtime_get_interface_id (rt, name) == ids[n]);
+    }
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void
+test_interface_registry ()
+{
+    printf ("Test registering interface names concurrently (%d)\n",
+            __LINE__);
+
+    static int ids[REGISTRY_THREADS][REGISTRY_NAMES];
+    int first = y_Runtime_get_interface_id (rt, "first");
+    int i, j;
+
+    run_threads (REGISTRY_THREADS, register_thread, ids);
+
+    /* Every thread got the same identifiers, all new and distinct */
+    for ( j = 0; j < REGISTRY_NAMES; j++ ) {
+        for ( i = 1; i < REGISTRY_THREADS; i++ ) {
+            assert (ids[i][j] == ids[0][j]);
+        }
+        assert (ids[0][j] > first && ids[0][j] <= first + REGISTRY_NAMES);
+        for ( i = 0; i < j; i++ ) {
+            assert (ids[0][i] != ids[0][j]);
+        }
+    }
+    /* Names registered before are unchanged */
+    assert (y_Runtime_get_interface_id (rt, "first") == first);
+    assert (y_Runtime_get_interface_id (rt, Beta_name) ==
+            y_Runtime_find_interface (rt, &Beta_interface));
+}
+
 int
 main ()
 {
@@ -100,6 +415,13 @@ main ()
     test_interface_id ();
     test_interface_get_implementation ();
     test_interface_use ();
+    test_interface_packing ();
+    test_interface_descriptor ();
+    test_interface_inheritance ();
+    test_interface_inline_cache ();
+    test_interface_ref ();
+    test_interface_registry ();
+    test_interface_runtimes ();
 
     teardown ();
     return 0;
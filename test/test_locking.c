@@ -0,0 +1,181 @@
+/**
+ * Test suite: locking several objects.
+ *
+ * Objects locked together are locked in a canonical order, so threads locking 
+ * the same objects in different orders cannot deadlock.  Locks are 
+ * re-entrant, so that y_assign can hold both objects' locks while setters 
+ * lock them again.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <apr_thread_proc.h>
+#include <yakka/Yakka.h>
+#include <yakka/Object-protected.h>
+#include <test/ootest/Alpha.h>
+#include <test/ootest/Delta.h>
+#include <test/threads.h>
+
+#define LOCKING_ITERATIONS  10000
+
+y_Runtime * rt;
+
+void setup ()
+{
+    apr_status_t apr_status;
+
+    apr_status = apr_initialize ();
+    if ( apr_status != APR_SUCCESS )
+        abort ();
+
+    rt = y_Runtime_new (NULL, NULL, 1024, true);
+    assert (rt);
+}
+
+void
+teardown ()
+{
+    y_Runtime_destroy (rt);
+    apr_terminate ();
+}
+
+/*
+ * Repeatedly lock a pair of objects, and move a unit from one to the other.  
+ * Even threads move units forward, odd threads backward, so the two lock the 
+ * objects in opposite orders.
+ */
+void * APR_THREAD_FUNC
+transfer_thread (apr_thread_t * thread, void * data)
+{
+    TestThread * test_thread = (TestThread *)data;
+    void ** objects = ((void ***)test_thread->data)[test_thread->index % 2];
+    Alpha * from = objects[0];
+    Alpha * to = objects[1];
+    int i;
+
+    for ( i = 0; i < LOCKING_ITERATIONS; i++ ) {
+        y_lock_many (objects, 2);
+        from->a--;
+        to->a++;
+        y_unlock_many (objects, 2);
+    }
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void
+test_lock_many ()
+{
+    printf ("Test that threads locking objects in opposite orders do not "
+            "deadlock (%d)\n", __LINE__);
+
+    Alpha * alpha1 = Alpha_new (rt, 0, NULL);
+    Alpha * alpha2 = Alpha_new (rt, 0, NULL);
+    void * forward[] = { alpha1, alpha2 };
+    void * backward[] = { alpha2, alpha1 };
+    void ** orders[] = { forward, backward };
+
+    run_threads (2, transfer_thread, orders);
+
+    /* Every transfer happened atomically */
+    assert (Alpha_get (alpha1) == 0);
+    assert (Alpha_get (alpha2) == 0);
+
+    y_unref (alpha2);
+    y_unref (alpha1);
+}
+
+void * APR_THREAD_FUNC
+try_lock_thread (apr_thread_t * thread, void * data)
+{
+    void ** objects = ((TestThread *)data)->data;
+
+    *(bool *)objects[2] = y_try_lock_many (objects, 2);
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void
+test_try_lock_many ()
+{
+    printf ("Test that trying to lock objects backs off if one is "
+            "locked (%d)\n", __LINE__);
+
+    Alpha * alpha1 = Alpha_new (rt, 0, NULL);
+    Alpha * alpha2 = Alpha_new (rt, 0, NULL);
+    bool acquired = true;
+    void * objects[] = { alpha1, alpha2, &acquired };
+    unsigned long contention = y_Runtime_get_lock_contention (rt);
+
+    y_lock (alpha2);
+    run_threads (1, try_lock_thread, objects);
+    y_unlock (alpha2);
+    assert (! acquired);
+    assert (y_Runtime_get_lock_contention (rt) == contention + 1);
+
+    /* Nothing was left locked */
+    assert (y_try_lock_many (objects, 2));
+    y_unlock_many (objects, 2);
+
+    y_unref (alpha2);
+    y_unref (alpha1);
+}
+
+void
+test_nested_lock ()
+{
+    printf ("Test that a lock can be taken again by its holder (%d)\n",
+            __LINE__);
+
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+    void * objects[] = { alpha, alpha, NULL };
+    unsigned int version = y_read_begin (alpha);
+
+    y_lock_many (objects, 3);
+    y_lock (alpha);
+    assert (y_OBJECT_PROTECTED (alpha)->lock_depth == 2);
+    y_unlock (alpha);
+    y_unlock_many (objects, 3);
+    assert (y_OBJECT_PROTECTED (alpha)->lock_depth == 0);
+    assert (y_read_retry (alpha, version));
+    assert (! (y_read_begin (alpha) & 1));
+
+    y_unref (alpha);
+}
+
+void
+test_assign_locked ()
+{
+    printf ("Test assigning between objects of a threadsafe runtime (%d)\n",
+            __LINE__);
+
+    Delta * delta1 = Delta_new (rt, 1, "b", NULL, "d", NULL);
+    Delta * delta2 = Delta_new (rt, 0, NULL, NULL, NULL, NULL);
+    Delta * delta3 = NULL;
+
+    assert (y_assign (delta2, delta1, NULL) == delta2);
+    assert (Alpha_get ((Alpha *)delta2) == 1);
+    delta3 = y_copy (delta2, NULL);
+    assert (delta3);
+    assert (Alpha_get ((Alpha *)delta3) == 1);
+
+    y_unref (delta3);
+    y_unref (delta2);
+    y_unref (delta1);
+}
+
+int
+main ()
+{
+    setup ();
+
+    test_lock_many ();
+    test_try_lock_many ();
+    test_nested_lock ();
+    test_assign_locked ();
+
+    teardown ();
+    return 0;
+}
+
+#undef LOCKING_ITERATIONS
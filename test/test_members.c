@@ -122,6 +122,33 @@ test_set_individually ()
     y_unref (delta);
 }
 
+void
+test_set_steal ()
+{
+    printf ("Test handing a reference over to a setter (%d)\n", __LINE__);
+
+    y_Error * error = NULL;
+    Delta * delta = Delta_new (rt, 0, NULL, NULL, NULL, &error);
+    Gamma * gamma = Gamma_new (rt, &error);
+    Gamma * c = gamma;
+    y_WeakRef * weak_ref = y_weak_ref (gamma);
+
+    assert (! error);
+    assert (delta);
+    Delta_set_c_steal (delta, y_move (&gamma));
+    assert (gamma == NULL);
+    assert (Delta_get_c (delta) == c);
+    assert (y_move (&gamma) == NULL);
+    assert (y_move_ (NULL) == NULL);
+
+    /* The member held the only reference */
+    Delta_set_c_steal (delta, NULL);
+    assert (! y_WeakRef_is_set (weak_ref));
+
+    y_unref (weak_ref);
+    y_unref (delta);
+}
+
 void
 test_clear ()
 {
@@ -206,6 +233,7 @@ int main ()
 
     test_set_on_construction ();
     test_set_individually ();
+    test_set_steal ();
     test_clear ();
     test_copy ();
     test_assign ();
@@ -0,0 +1,224 @@
+/**
+ * Test suite: monitors.
+ *
+ * Objects with a mutex can be used as monitors: a thread holding the lock can 
+ * wait on the object until another thread notifies it.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <apr_thread_proc.h>
+#include <yakka/Yakka.h>
+#include <yakka/Object-protected.h>
+#include <test/ootest/Alpha.h>
+#include <test/ootest/Epsilon.h>
+#include <test/threads.h>
+
+#define MONITOR_THREADS  3
+
+y_Runtime * rt;
+
+void setup ()
+{
+    apr_status_t apr_status;
+
+    apr_status = apr_initialize ();
+    if ( apr_status != APR_SUCCESS )
+        abort ();
+
+    rt = y_Runtime_new (NULL, NULL, 1024, true);
+    assert (rt);
+}
+
+void
+teardown ()
+{
+    y_Runtime_destroy (rt);
+    apr_terminate ();
+}
+
+/*
+ * Wait until the value of an Alpha is set, then increase it.
+ */
+void
+consume (Alpha * alpha)
+{
+    y_lock (alpha);
+    while ( alpha->a == 0 ) {
+        y_wait (alpha, -1);
+    }
+    alpha->a++;
+    y_unlock (alpha);
+}
+
+/*
+ * Wait until a number of threads wait on an Alpha.
+ */
+void
+wait_for_waiters (Alpha * alpha, unsigned int waiters)
+{
+    bool waiting = false;
+
+    while ( ! waiting ) {
+        y_lock (alpha);
+        waiting = ( y_OBJECT_PROTECTED (alpha)->waiters == waiters );
+        y_unlock (alpha);
+        apr_thread_yield ();
+    }
+}
+
+/*
+ * Thread 0 sets the value of an Alpha once the other threads (consumers) all 
+ * wait for it, and notifies them.
+ */
+void
+produce_or_consume (TestThread * test_thread, int consumers)
+{
+    Alpha * alpha = (Alpha *)test_thread->data;
+
+    if ( test_thread->index > 0 ) {
+        consume (alpha);
+        return;
+    }
+    wait_for_waiters (alpha, consumers);
+    y_lock (alpha);
+    alpha->a = 1;
+    if ( consumers == 1 ) {
+        y_notify (alpha);
+    }
+    else {
+        y_notify_all (alpha);
+    }
+    y_unlock (alpha);
+}
+
+void * APR_THREAD_FUNC
+notify_thread (apr_thread_t * thread, void * data)
+{
+    produce_or_consume ((TestThread *)data, 1);
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void * APR_THREAD_FUNC
+notify_all_thread (apr_thread_t * thread, void * data)
+{
+    produce_or_consume ((TestThread *)data, MONITOR_THREADS);
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void
+test_wait_notify ()
+{
+    printf ("Test waiting on an object until it is notified (%d)\n",
+            __LINE__);
+
+    Alpha * alpha = Alpha_new (rt, 0, NULL);
+
+    run_threads (2, notify_thread, alpha);
+    assert (Alpha_get (alpha) == 2);
+
+    y_unref (alpha);
+}
+
+void
+test_notify_all ()
+{
+    printf ("Test waking all the threads waiting on an object (%d)\n",
+            __LINE__);
+
+    Alpha * alpha = Alpha_new (rt, 0, NULL);
+
+    run_threads (1 + MONITOR_THREADS, notify_all_thread, alpha);
+    assert (Alpha_get (alpha) == 1 + MONITOR_THREADS);
+
+    y_unref (alpha);
+}
+
+/*
+ * Thread 0 waits until the value of an Alpha is set; thread 1 sets it while 
+ * thread 0 waits, checking that its write is seen as one by readers.
+ */
+void * APR_THREAD_FUNC
+write_while_waiting_thread (apr_thread_t * thread, void * data)
+{
+    TestThread * test_thread = (TestThread *)data;
+    Alpha * alpha = (Alpha *)test_thread->data;
+    y_ObjectProtected * prot = y_OBJECT_PROTECTED (alpha);
+    unsigned int version;
+
+    if ( test_thread->index == 0 ) {
+        consume (alpha);
+        apr_thread_exit (thread, APR_SUCCESS);
+        return NULL;
+    }
+    wait_for_waiters (alpha, 1);
+    /* No write in progress while thread 0 waits... */
+    version = atomic_load (&(prot->version));
+    assert (version % 2 == 0);
+    /* ...and this thread's is one */
+    y_lock (alpha);
+    assert (prot->lock_depth == 1);
+    assert (atomic_load (&(prot->version)) == version + 1);
+    alpha->a = 1;
+    y_notify (alpha);
+    y_unlock (alpha);
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void
+test_write_while_waiting ()
+{
+    printf ("Test writing an object while another thread waits on it (%d)\n",
+            __LINE__);
+
+    Alpha * alpha = Alpha_new (rt, 0, NULL);
+    unsigned int version;
+
+    run_threads (2, write_while_waiting_thread, alpha);
+    assert (Alpha_get (alpha) == 2);
+    version = atomic_load (&(y_OBJECT_PROTECTED (alpha)->version));
+    assert (version % 2 == 0);
+
+    y_unref (alpha);
+}
+
+void
+test_wait_timeout ()
+{
+    printf ("Test that a wait times out without a notification (%d)\n",
+            __LINE__);
+
+    Alpha * alpha = Alpha_new (rt, 0, NULL);
+    Epsilon * epsilon = Epsilon_new (rt, 0, NULL);
+
+    /* Nobody waiting: nothing happens */
+    y_lock (alpha);
+    y_notify (alpha);
+    assert (! y_wait (alpha, 1000));
+    y_unlock (alpha);
+
+    /* No mutex: cannot be waited on */
+    assert (! y_wait (epsilon, -1));
+
+    y_unref (epsilon);
+    y_unref (alpha);
+}
+
+int
+main ()
+{
+    setup ();
+
+    test_wait_notify ();
+    test_notify_all ();
+    test_write_while_waiting ();
+    test_wait_timeout ();
+
+    teardown ();
+    return 0;
+}
+
+#undef MONITOR_THREADS
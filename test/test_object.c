@@ -1,8 +1,16 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <apr_thread_proc.h>
 #include <yakka/Yakka.h>
+#include <yakka/Object-inline.h>
 #include <test/ootest/Alpha.h>
+#include <test/ootest/Beta.h>
+#include <test/ootest/Delta.h>
+#include <test/ootest/Epsilon.h>
+#include <test/ootest/Zeta-protected.h>
+#include <test/threads.h>
 
 y_Runtime * rt;
 
@@ -38,12 +46,419 @@ test_simple_object ()
     y_unref (alpha);
 }
 
+void
+test_optimistic_read ()
+{
+    printf ("Test reading an object without locking it (%d)\n", __LINE__);
+
+    /* Only objects with a mutex, in a threadsafe runtime, have versions */
+    y_Runtime * shared_rt = y_Runtime_new (NULL, NULL, 16, true);
+    y_Error * error = NULL;
+    Alpha * alpha = Alpha_new (shared_rt, 42, &error);
+    unsigned int version;
+
+    assert (alpha);
+    assert (Alpha_get (alpha) == 42);
+
+    /* Nothing written: the read is consistent */
+    version = y_read_begin (alpha);
+    assert (! (version & 1));
+    assert (! y_read_retry (alpha, version));
+
+    /* A write in between invalidates the read */
+    version = y_read_begin (alpha);
+    y_lock (alpha);
+    assert (y_read_retry (alpha, version));
+    y_unlock (alpha);
+    assert (y_read_retry (alpha, version));
+
+    /* Setter is a write */
+    version = y_read_begin (alpha);
+    Alpha_set (alpha, 7, &error);
+    assert (y_read_retry (alpha, version));
+    assert (Alpha_get (alpha) == 7);
+
+    y_unref (alpha);
+
+    /* Without a mutex, writes are not marked */
+    alpha = Alpha_new (rt, 42, &error);
+    version = y_read_begin (alpha);
+    Alpha_set (alpha, 7, &error);
+    assert (! y_read_retry (alpha, version));
+    assert (Alpha_get (alpha) == 7);
+
+    y_unref (alpha);
+    y_Runtime_destroy (shared_rt);
+}
+
+void
+test_freeze ()
+{
+    printf ("Test that a frozen object cannot be modified (%d)\n", __LINE__);
+
+    y_Error * error = NULL;
+    Alpha * alpha = Alpha_new (rt, 42, &error);
+    Alpha * other = Alpha_new (rt, 7, &error);
+    unsigned int version;
+
+    assert (! error);
+    assert (! y_is_frozen (alpha));
+    y_freeze (alpha);
+    assert (y_is_frozen (alpha));
+
+    Alpha_set (alpha, 1, &error);
+    assert (error);
+    assert (Alpha_get (alpha) == 42);
+    y_unref (error);
+    error = NULL;
+
+    assert (y_assign (alpha, other, &error) == NULL);
+    y_clear (alpha);
+    assert (Alpha_get (alpha) == 42);
+
+    printf ("Test that a frozen object needs no locking (%d)\n", __LINE__);
+
+    version = y_read_begin (alpha);
+    y_lock (alpha);
+    assert (! y_read_retry (alpha, version));
+    y_unlock (alpha);
+    assert (y_try_lock (alpha));
+    y_unlock (alpha);
+    assert (! y_lock_for_write (alpha));
+
+    printf ("Test that copying a frozen object shares it (%d)\n", __LINE__);
+
+    assert (y_copy (alpha, &error) == alpha);
+    assert (! error);
+    y_unref (alpha);
+
+    /* It can still be assigned from */
+    assert (y_assign (other, alpha, &error) == other);
+    assert (Alpha_get (other) == 42);
+
+    y_unref (other);
+    y_unref (alpha);
+}
+
+void
+test_is_a ()
+{
+    printf ("Test checking the type of an object (%d)\n", __LINE__);
+
+    y_Error * error = NULL;
+    Alpha * alpha = Alpha_new (rt, 1, &error);
+    Epsilon * epsilon = Epsilon_new (rt, 2, &error);
+
+    assert (y_is_a (epsilon, Epsilon_type (rt)));
+    assert (y_is_a (epsilon, Alpha_type (rt)));
+    assert (y_is_a (epsilon, y_Object_type (rt)));
+    assert (! y_is_a (epsilon, Delta_type (rt)));
+
+    assert (y_is_a (alpha, Alpha_type (rt)));
+    assert (y_is_a (alpha, y_Object_type (rt)));
+    assert (! y_is_a (alpha, Epsilon_type (rt)));
+
+    /* The inline fast path agrees */
+    assert (y_is_a_inline (epsilon, Alpha_type (rt)));
+    assert (! y_is_a_inline (epsilon, Delta_type (rt)));
+    assert (! y_is_a_inline (alpha, Epsilon_type (rt)));
+    assert (! y_is_a_inline (NULL, Alpha_type (rt)));
+    assert (y_get_runtime_inline (epsilon) == rt);
+
+    y_unref (epsilon);
+    y_unref (alpha);
+}
+
+void
+test_runtime_types ()
+{
+    printf ("Test the classes of independent runtimes (%d)\n", __LINE__);
+
+    y_Runtime * other_rt = y_Runtime_new (NULL, NULL, 16, true);
+    y_Error * error = NULL;
+    Alpha * alpha = Alpha_new (rt, 1, &error);
+    Alpha * other_alpha = Alpha_new (other_rt, 2, &error);
+
+    /* Each runtime has its own class structures */
+    assert (Alpha_type (other_rt) != Alpha_type (rt));
+    assert (y_Object_type (other_rt) != y_Object_type (rt));
+    assert (((y_ObjectClass *)Alpha_type (other_rt))->super ==
+            y_Object_type (other_rt));
+    assert (y_is_a (other_alpha, Alpha_type (other_rt)));
+    assert (! y_is_a (other_alpha, Alpha_type (rt)));
+    assert (! y_is_a (alpha, Alpha_type (other_rt)));
+    assert (Epsilon_type (other_rt) != Epsilon_type (rt));
+
+    y_unref (other_alpha);
+    y_Runtime_destroy (other_rt);
+
+    /* The classes of this runtime survive the other one */
+    assert (y_is_a (alpha, Alpha_type (rt)));
+    assert (Alpha_get (alpha) == 1);
+    y_unref (alpha);
+    alpha = Alpha_new (rt, 3, &error);
+    assert (alpha && ! error);
+    y_unref (alpha);
+}
+
+void
+test_find_type ()
+{
+    printf ("Test finding classes by name (%d)\n", __LINE__);
+
+    y_Error * error = NULL;
+    void * alpha_type = Alpha_type (rt);
+    int alpha_id = y_Runtime_find_type_id (rt, "Alpha");
+
+    assert (y_Runtime_find_type (rt, "Alpha") == alpha_type);
+    assert (y_Runtime_find_type (rt, "Object") == y_Object_type (rt));
+    assert (alpha_id > 0);
+    assert (y_Runtime_get_type_by_id (rt, alpha_id) == alpha_type);
+    assert (y_Runtime_find_type_id (rt, "Epsilon") != alpha_id);
+
+    /* Not a class */
+    assert (y_Runtime_find_type (rt, "Nothing") == NULL);
+    assert (y_Runtime_find_type_id (rt, "Nothing") == 0);
+    assert (y_Runtime_find_type (rt, NULL) == NULL);
+    assert (y_Runtime_find_type_id (rt, NULL) == 0);
+    assert (y_Runtime_get_type_by_id (rt, 0) == NULL);
+
+    Alpha * alpha = y_create_by_name (rt, "Alpha", &error);
+    assert (alpha && ! error);
+    assert (y_is_a (alpha, alpha_type));
+    y_unref (alpha);
+
+    assert (y_create_by_name (rt, "Nothing", &error) == NULL);
+    assert (error && y_Error_get_code (error) == APR_EINVAL);
+    y_unref (error);
+    error = NULL;
+    assert (y_create_by_name (rt, NULL, &error) == NULL);
+    assert (error && y_Error_get_code (error) == APR_EINVAL);
+    y_unref (error);
+}
+
+/* Not allowed: Zeta is final */
+typedef struct Eta {
+    Zeta        zeta;
+} Eta;
+
+typedef struct EtaProtected {
+    ZetaProtected       zeta;
+} EtaProtected;
+
+typedef struct EtaClass {
+    ZetaClass       zeta;
+} EtaClass;
+
+y_DEFINE_CLASS (Eta, Zeta, NULL, NULL, NULL, 0)
+
+void
+test_final_class ()
+{
+    printf ("Test final classes (%d)\n", __LINE__);
+
+    y_Error * error = NULL;
+    Zeta * zeta = Zeta_new (rt, &error);
+    Gamma * gamma = Gamma_new (rt, &error);
+    y_ObjectClass * type = (y_ObjectClass *)Zeta_type (rt);
+
+    assert (type->flags & y_TYPE_FINAL);
+    assert (! (((y_ObjectClass *)Gamma_type (rt))->flags & y_TYPE_FINAL));
+    assert (y_is_a (zeta, Zeta_type (rt)));
+    assert (y_is_a (zeta, Gamma_type (rt)));
+    assert (! y_is_a (gamma, Zeta_type (rt)));
+    assert (y_is_a_inline (zeta, Zeta_type (rt)));
+    assert (! y_is_a_inline (gamma, Zeta_type (rt)));
+
+    /* Can't be subclassed */
+    assert (Eta_type (rt) == NULL);
+    assert (y_create (rt, Eta_type (rt), &error) == NULL);
+    assert (error && y_Error_get_code (error) == APR_EINVAL);
+    y_unref (error);
+
+    y_unref (gamma);
+    y_unref (zeta);
+}
+
+#define INIT_THREADS  4
+#define INIT_CLASSES  3
+
+y_Runtime * init_rt;
+
+/*
+ * Get classes that are not yet initialised, each thread in a different order, 
+ * recording the class structures.
+ */
+void * APR_THREAD_FUNC
+init_thread (apr_thread_t * thread, void * data)
+{
+    TestThread * test_thread = (TestThread *)data;
+    void ** types = ((void * (*)[INIT_CLASSES])test_thread->data)[
+        test_thread->index];
+    int i;
+
+    for ( i = 0; i < INIT_CLASSES; i++ ) {
+        int n = (i + test_thread->index) % INIT_CLASSES;
+        switch ( n ) {
+            case 0: types[n] = Delta_type (init_rt); break;
+            case 1: types[n] = Zeta_type (init_rt); break;
+            case 2: types[n] = Epsilon_type (init_rt); break;
+        }
+    }
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void
+test_concurrent_type_init ()
+{
+    printf ("Test initialising classes concurrently (%d)\n", __LINE__);
+
+    static void * types[INIT_THREADS][INIT_CLASSES];
+    int i, j;
+
+    init_rt = y_Runtime_new (NULL, NULL, 16, true);
+    run_threads (INIT_THREADS, init_thread, types);
+
+    /* Each class was initialised once */
+    for ( i = 0; i < INIT_THREADS; i++ ) {
+        for ( j = 0; j < INIT_CLASSES; j++ ) {
+            assert (types[i][j] && types[i][j] == types[0][j]);
+        }
+    }
+    assert (types[0][0] == Delta_type (init_rt));
+    assert (((y_ObjectClass *)Delta_type (init_rt))->super ==
+            Alpha_type (init_rt));
+    assert (((y_ObjectClass *)Zeta_type (init_rt))->super ==
+            Gamma_type (init_rt));
+
+    y_Error * error = NULL;
+    Zeta * zeta = Zeta_new (init_rt, &error);
+    assert (zeta && ! error);
+    assert (Beta_do_action (zeta) == Zeta_default);
+    y_unref (zeta);
+
+    y_Runtime_destroy (init_rt);
+}
+
+/* Two classes, each of which needs the other to be initialised */
+y_TypeSlot cycle_slots[2];
+void * cycle_types[2];
+void * cycle_needed[2];
+atomic_int cycle_started;
+
+void * cycle_type (int n);
+
+void
+cycle_init (int n)
+{
+    /* Both are being initialised before either needs the other */
+    atomic_fetch_add (&cycle_started, 1);
+    while ( atomic_load (&cycle_started) < 2 ) {
+        apr_thread_yield ();
+    }
+    cycle_needed[n] = cycle_type (1 - n);
+}
+
+void
+cycle_init_0 (y_Runtime * rt, void * type, void * super_type)
+{
+    cycle_init (0);
+}
+
+void
+cycle_init_1 (y_Runtime * rt, void * type, void * super_type)
+{
+    cycle_init (1);
+}
+
+void *
+cycle_type (int n)
+{
+    return y_Runtime_init_type (init_rt, NULL, sizeof (y_ObjectClass),
+            y_Object_type (init_rt), ( n ? cycle_init_1 : cycle_init_0 ),
+            &(cycle_slots[n]));
+}
+
+void * APR_THREAD_FUNC
+cycle_thread (apr_thread_t * thread, void * data)
+{
+    int n = ((TestThread *)data)->index;
+
+    cycle_types[n] = cycle_type (n);
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void
+test_type_init_cycle ()
+{
+    printf ("Test classes that need each other (%d)\n", __LINE__);
+
+    init_rt = y_Runtime_new (NULL, NULL, 16, true);
+    run_threads (2, cycle_thread, NULL);
+
+    /* The thread that would have closed the cycle did without the class */
+    assert (cycle_types[0] && cycle_types[1]);
+    assert (! cycle_needed[0] != ! cycle_needed[1]);
+    assert (cycle_needed[0] == NULL || cycle_needed[0] == cycle_types[1]);
+    assert (cycle_needed[1] == NULL || cycle_needed[1] == cycle_types[0]);
+
+    y_Runtime_destroy (init_rt);
+}
+
+extern const y_ClassDesc Epsilon_class_desc;
+extern const y_ClassDesc Zeta_class_desc;
+
+void
+test_class_desc ()
+{
+    printf ("Test classes defined by a class descriptor (%d)\n", __LINE__);
+
+    /* Initialised at startup, without being used */
+    assert (! y_Runtime_get_type (rt, Epsilon_class_desc.type_slot));
+    y_REGISTER_CLASSES (rt);
+#ifdef y_HAVE_CLASS_SECTION
+    assert (y_Runtime_get_type (rt, Epsilon_class_desc.type_slot));
+#endif /* y_HAVE_CLASS_SECTION */
+
+    y_Error * error = NULL;
+    Epsilon * epsilon = Epsilon_new (rt, 3, &error);
+    y_ObjectClass * type = (y_ObjectClass *)Epsilon_type (rt);
+
+    assert (epsilon);
+    assert (type == y_Runtime_get_type (rt, Epsilon_class_desc.type_slot));
+    assert (type->super == Alpha_type (rt));
+    assert (strcmp (type->name, "Epsilon") == 0);
+    assert (type->instance_size == sizeof (Epsilon));
+    assert ((type->flags & y_TYPE_THREAD_POLICY) == y_TYPE_CONFINED);
+    assert (y_is_a (epsilon, Alpha_type (rt)));
+    assert (Alpha_get ((Alpha *)epsilon) == 3);
+
+    /* With interfaces */
+    type = (y_ObjectClass *)Zeta_type (rt);
+    assert (type->super == Gamma_type (rt));
+    assert (y_get_implementation_by_name (y_OBJECT (epsilon), "Beta") == NULL);
+    assert (type->interfaces && type->interfaces->size == 1);
+
+    y_unref (epsilon);
+}
+
 int
 main ()
 {
     setup ();
 
+    test_class_desc ();
     test_simple_object ();
+    test_optimistic_read ();
+    test_freeze ();
+    test_is_a ();
+    test_runtime_types ();
+    test_find_type ();
+    test_final_class ();
+    test_concurrent_type_init ();
+    test_type_init_cycle ();
 
     teardown ();
     return 0;
@@ -0,0 +1,454 @@
+/**
+ * Test suite: reference counting.
+ *
+ * Shared objects are reference counted with a bias towards the thread that 
+ * created them.  These tests check that references acquired and released by 
+ * other threads are accounted for, including when the last reference is 
+ * released by a thread other than the creator, and after the creator exits 
+ * (when its state is reused by new threads, once nothing refers to it).
+ * The reference counts of "hot" objects are sharded between threads.  Objects 
+ * released within a borrow scope are only destroyed once it is closed.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <apr_thread_proc.h>
+#include <yakka/Yakka.h>
+#include <yakka/Object-inline.h>
+#include <test/ootest/Alpha.h>
+#include <test/ootest/Delta.h>
+#include <test/ootest/Epsilon.h>
+#include <test/threads.h>
+
+y_Runtime * rt;
+
+void setup ()
+{
+    apr_status_t apr_status;
+
+    apr_status = apr_initialize ();
+    if ( apr_status != APR_SUCCESS )
+        abort ();
+
+    rt = y_Runtime_new (NULL, NULL, 1024, true);
+    assert (rt);
+}
+
+void
+teardown ()
+{
+    y_Runtime_destroy (rt);
+    apr_terminate ();
+}
+
+void * APR_THREAD_FUNC
+ref_unref_thread (apr_thread_t * thread, void * data)
+{
+    void * obj = ((TestThread *)data)->data;
+    int i;
+    for ( i = 0; i < 1000; i++ ) {
+        assert (y_ref (obj) == obj);
+        y_unref (obj);
+    }
+    /* Keep one reference */
+    y_ref (obj);
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void * APR_THREAD_FUNC
+unref_thread (apr_thread_t * thread, void * data)
+{
+    y_unref (((TestThread *)data)->data);
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void * APR_THREAD_FUNC
+create_thread (apr_thread_t * thread, void * data)
+{
+    *(Alpha **)((TestThread *)data)->data = Alpha_new (rt, 1, NULL);
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void * APR_THREAD_FUNC
+thread_refs_thread (apr_thread_t * thread, void * data)
+{
+    *(y_ThreadRefs **)((TestThread *)data)->data =
+        y_Runtime_get_thread_refs (rt);
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void
+test_owner_refcount ()
+{
+    printf ("Test that the creating thread counts its references "
+            "locally (%d)\n", __LINE__);
+
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+    y_ObjectProtected * prot = y_OBJECT_PROTECTED (alpha);
+
+    assert (alpha);
+    assert (prot->local_refcount == 1);
+    assert (y_ref (alpha) == alpha);
+    assert (prot->local_refcount == 2);
+    assert (y_REFCOUNT_COUNT (atomic_load (&(prot->refcount))) == 0);
+    y_unref (alpha);
+    assert (prot->local_refcount == 1);
+
+    y_unref (alpha);
+}
+
+void
+test_other_thread_refcount ()
+{
+    printf ("Test that references from another thread are counted (%d)\n",
+            __LINE__);
+
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+    y_WeakRef * weak_ref = y_weak_ref (alpha);
+
+    /* The other thread keeps one reference of its own */
+    run_threads (1, ref_unref_thread, alpha);
+    y_unref (alpha);
+    assert (y_WeakRef_is_set (weak_ref));
+
+    /* ...which it hands back to this thread to release */
+    y_unref (alpha);
+    assert (! y_WeakRef_is_set (weak_ref));
+
+    y_unref (weak_ref);
+}
+
+void
+test_release_by_other_thread ()
+{
+    printf ("Test that an object released by another thread is destroyed "
+            "once its counts are merged (%d)\n", __LINE__);
+
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+    y_WeakRef * weak_ref = y_weak_ref (alpha);
+
+    /* The creating thread's reference is handed over and released */
+    run_threads (1, unref_thread, alpha);
+    assert (y_OBJECT_PROTECTED (alpha)->local_refcount == 1);
+    assert (atomic_load (&(y_OBJECT_PROTECTED (alpha)->refcount)) &
+            y_REFCOUNT_QUEUED);
+
+    y_Runtime_merge_refcounts (rt);
+    assert (! y_WeakRef_is_set (weak_ref));
+
+    y_unref (weak_ref);
+}
+
+void
+test_release_after_owner_exit ()
+{
+    printf ("Test that an object can be released after the thread that "
+            "created it exits (%d)\n", __LINE__);
+
+    Alpha * alpha = NULL;
+    y_WeakRef * weak_ref;
+
+    run_threads (1, create_thread, &alpha);
+    assert (alpha);
+    weak_ref = y_weak_ref (alpha);
+    assert (y_WeakRef_is_set (weak_ref));
+
+    /* No owner to merge the counts: merged by this thread */
+    y_unref (alpha);
+    assert (! y_WeakRef_is_set (weak_ref));
+
+    y_unref (weak_ref);
+}
+
+void
+test_thread_refs_reuse ()
+{
+    printf ("Test that the state of exited threads is reused (%d)\n",
+            __LINE__);
+
+    Alpha * alpha = NULL;
+    y_ThreadRefs * owner;
+    y_ThreadRefs * first = NULL;
+    y_ThreadRefs * refs = NULL;
+    int i;
+
+    run_threads (1, create_thread, &alpha);
+    assert (alpha);
+    owner = ((y_Object *)alpha)->protect->owner_refs;
+    assert (atomic_load (&(owner->exited)));
+    assert (atomic_load (&(owner->holders)) == 1);
+
+    /* Threads that leave nothing behind hand their state on */
+    run_threads (1, thread_refs_thread, &first);
+    for ( i = 0; i < 8; i++ ) {
+        run_threads (1, thread_refs_thread, &refs);
+        assert (refs == first);
+    }
+    /* ...but not while an object is still biased towards its owner */
+    assert (first != owner);
+
+    y_unref (alpha);
+    assert (atomic_load (&(owner->holders)) == 0);
+}
+
+void
+test_hot_refcount ()
+{
+    printf ("Test that the references to a hot object are counted in "
+            "shards (%d)\n", __LINE__);
+
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+    y_WeakRef * weak_ref = y_weak_ref (alpha);
+    y_ObjectProtected * prot = y_OBJECT_PROTECTED (alpha);
+
+    assert (y_make_shared_hot (alpha));
+    assert (y_make_shared_hot (alpha));
+    assert (atomic_load (&(prot->hot_state)) == y_REFS_HOT);
+
+    /* Two other threads keep a reference each */
+    run_threads (1, ref_unref_thread, alpha);
+    run_threads (1, ref_unref_thread, alpha);
+    assert (y_REFCOUNT_COUNT (atomic_load (&(prot->refcount))) == 1);
+
+    y_make_shared_cold (alpha);
+    assert (atomic_load (&(prot->hot_state)) == y_REFS_COLD);
+    assert (y_REFCOUNT_COUNT (atomic_load (&(prot->refcount))) == 3);
+
+    y_unref (alpha);
+    y_unref (alpha);
+    assert (y_WeakRef_is_set (weak_ref));
+    y_unref (alpha);
+    assert (! y_WeakRef_is_set (weak_ref));
+
+    y_unref (weak_ref);
+}
+
+void
+test_hot_release ()
+{
+    printf ("Test that a hot object is destroyed when its last reference is "
+            "released (%d)\n", __LINE__);
+
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+    y_WeakRef * weak_ref = y_weak_ref (alpha);
+    y_ObjectProtected * prot = y_OBJECT_PROTECTED (alpha);
+
+    assert (y_make_shared_hot (alpha));
+    run_threads (1, ref_unref_thread, alpha);
+
+    /* Released from the other thread's shard: the shared count drops to zero, 
+     * but the object stays hot */
+    y_unref (alpha);
+    assert (atomic_load (&(prot->hot_state)) == y_REFS_HOT);
+    assert (y_REFCOUNT_COUNT (atomic_load (&(prot->refcount))) == 1);
+    assert (y_WeakRef_is_set (weak_ref));
+
+    /* Released by yet another thread, as well as the reference it holds */
+    run_threads (1, ref_unref_thread, alpha);
+    run_threads (1, unref_thread, alpha);
+    assert (atomic_load (&(prot->hot_state)) == y_REFS_HOT);
+    assert (y_WeakRef_is_set (weak_ref));
+
+    /* The shards are folded back into the shared count... */
+    y_make_shared_cold (alpha);
+    assert (atomic_load (&(prot->hot_state)) == y_REFS_COLD);
+    assert (y_REFCOUNT_COUNT (atomic_load (&(prot->refcount))) == 1);
+
+    /* ...and the object can be made hot again */
+    assert (y_make_shared_hot (alpha));
+    run_threads (1, unref_thread, alpha);
+    assert (! y_WeakRef_is_set (weak_ref));
+
+    y_unref (weak_ref);
+}
+
+void
+test_hot_confined ()
+{
+    printf ("Test that a confined object cannot be made hot (%d)\n",
+            __LINE__);
+
+    Epsilon * epsilon = Epsilon_new (rt, 1, NULL);
+
+    assert (! y_make_shared_hot (epsilon));
+    y_unref (epsilon);
+}
+
+apr_status_t
+set_destroyed (void * data)
+{
+    *(bool *)data = true;
+    return APR_SUCCESS;
+}
+
+/*
+ * Create a Gamma, and note when it is destroyed (its pool is cleared).
+ */
+Gamma *
+new_watched_gamma (bool * destroyed)
+{
+    Gamma * gamma = Gamma_new (rt, NULL);
+
+    *destroyed = false;
+    apr_pool_cleanup_register (y_OBJECT_PROTECTED (gamma)->pool, destroyed,
+            set_destroyed, apr_pool_cleanup_null);
+    return gamma;
+}
+
+void
+test_borrow ()
+{
+    printf ("Test that a borrowed object is not destroyed until the borrow "
+            "scope is closed (%d)\n", __LINE__);
+
+    bool destroyed;
+    Gamma * gamma = new_watched_gamma (&destroyed);
+    Delta * delta = Delta_new (rt, 0, NULL, NULL, NULL, NULL);
+
+    Delta_set_c_steal (delta, y_move (&gamma));
+    y_BORROW (delta) {
+        Gamma * c = Delta_get_c (delta);
+
+        y_BORROW (delta) {
+            Delta_set_c (delta, NULL);
+        }
+        assert (! destroyed);
+        assert (y_OBJECT_PROTECTED (c)->retired_epoch);
+    }
+    assert (destroyed);
+
+    /* Without a scope, the object is destroyed at once */
+    gamma = new_watched_gamma (&destroyed);
+    Delta_set_c_steal (delta, y_move (&gamma));
+    Delta_set_c (delta, NULL);
+    assert (destroyed);
+
+    y_unref (delta);
+}
+
+void * APR_THREAD_FUNC
+borrow_thread (apr_thread_t * thread, void * data)
+{
+    Delta * delta = ((TestThread *)data)->data;
+
+    /* Released by another thread, while borrowed by the main thread */
+    Delta_set_c (delta, NULL);
+    apr_thread_exit (thread, APR_SUCCESS);
+    return NULL;
+}
+
+void
+test_borrow_other_thread ()
+{
+    printf ("Test that an object borrowed by one thread survives its release "
+            "by another (%d)\n", __LINE__);
+
+    bool destroyed;
+    Gamma * gamma = new_watched_gamma (&destroyed);
+    Delta * delta = Delta_new (rt, 0, NULL, NULL, NULL, NULL);
+
+    Delta_set_c_steal (delta, y_move (&gamma));
+    y_borrow_begin (delta);
+    gamma = Delta_get_c (delta);
+    run_threads (1, borrow_thread, delta);
+    /* This thread created it, so merges its count */
+    y_Runtime_merge_refcounts (rt);
+    assert (! destroyed);
+    assert (y_OBJECT_PROTECTED (gamma)->retired_epoch);
+    y_borrow_end (delta);
+    assert (destroyed);
+
+    y_unref (delta);
+}
+
+void
+test_ref_many ()
+{
+    printf ("Test acquiring and releasing references to an array of "
+            "objects (%d)\n", __LINE__);
+
+    Alpha * alpha1 = Alpha_new (rt, 1, NULL);
+    Alpha * alpha2 = Alpha_new (rt, 2, NULL);
+    y_WeakRef * weak_ref1 = y_weak_ref (alpha1);
+    y_WeakRef * weak_ref2 = y_weak_ref (alpha2);
+    void * objects[] = { alpha1, alpha1, NULL, alpha2, alpha1 };
+
+    y_ref_many (objects, 5);
+    assert (y_OBJECT_PROTECTED (alpha1)->local_refcount == 4);
+    assert (y_OBJECT_PROTECTED (alpha2)->local_refcount == 2);
+    y_unref_many (objects, 5);
+    assert (y_OBJECT_PROTECTED (alpha1)->local_refcount == 1);
+    assert (y_OBJECT_PROTECTED (alpha2)->local_refcount == 1);
+
+    /* The last references: both destroyed */
+    y_unref_many (objects + 2, 3);
+    assert (! y_WeakRef_is_set (weak_ref1));
+    assert (! y_WeakRef_is_set (weak_ref2));
+
+    y_unref (weak_ref1);
+    y_unref (weak_ref2);
+}
+
+void
+test_inline_refcount ()
+{
+    printf ("Test the inline reference counting fast paths (%d)\n",
+            __LINE__);
+
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+    Epsilon * epsilon = Epsilon_new (rt, 2, NULL);
+    y_ObjectProtected * prot = y_OBJECT_PROTECTED (alpha);
+    y_WeakRef * weak_ref;
+
+    /* The owner counts locally, as y_ref does */
+    assert (y_ref_inline (alpha) == alpha);
+    assert (prot->local_refcount == 2);
+    y_unref_inline (alpha);
+    assert (prot->local_refcount == 1);
+    assert (y_ref_inline (NULL) == NULL);
+    y_unref_inline (NULL);
+
+    /* Confined: a plain count */
+    assert (y_ref_inline (epsilon) == epsilon);
+    assert (y_REFCOUNT_COUNT (atomic_load (
+                    &(y_OBJECT_PROTECTED (epsilon)->refcount))) == 2);
+    y_unref_inline (epsilon);
+    weak_ref = y_weak_ref (epsilon);
+    y_unref_inline (epsilon);
+    assert (! y_WeakRef_is_set (weak_ref));
+    y_unref (weak_ref);
+
+    /* The last reference goes to the library, which destroys the object */
+    weak_ref = y_weak_ref (alpha);
+    y_ref (alpha);
+    y_unref_inline (alpha);
+    y_unref_inline (alpha);
+    assert (! y_WeakRef_is_set (weak_ref));
+    y_unref (weak_ref);
+}
+
+int
+main ()
+{
+    setup ();
+
+    test_owner_refcount ();
+    test_other_thread_refcount ();
+    test_release_by_other_thread ();
+    test_release_after_owner_exit ();
+    test_thread_refs_reuse ();
+    test_hot_refcount ();
+    test_hot_release ();
+    test_hot_confined ();
+    test_borrow ();
+    test_borrow_other_thread ();
+    test_ref_many ();
+    test_inline_refcount ();
+
+    teardown ();
+    return 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * Test suite: sealing the runtime.
+ *
+ * Each test program has its own runtime; this one is sealed by the first test,
+ * so the classes used afterwards must have been registered before.  Another 
+ * runtime is sealed while a class is being initialised.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <yakka/Yakka.h>
+#include <yakka/Object-protected.h>
+#include "ootest/Alpha.h"
+#include "ootest/Beta.h"
+#include "ootest/Gamma.h"
+#include "ootest/Zeta.h"
+
+y_Runtime * rt;
+
+y_DEFINE_INTERFACE (late_interface, "late");
+
+void setup ()
+{
+    apr_status_t apr_status;
+
+    apr_status = apr_initialize ();
+    if ( apr_status != APR_SUCCESS )
+        abort ();
+
+    rt = y_Runtime_new (NULL, NULL, 1024, true);
+    assert (rt);
+}
+
+void
+teardown ()
+{
+    y_Runtime_destroy (rt);
+    apr_terminate ();
+}
+
+void
+test_seal ()
+{
+    printf ("Test sealing the runtime (%d)\n", __LINE__);
+
+    /* Startup: register what the program uses */
+    assert (Gamma_type (rt));
+    int beta_id = y_Runtime_get_interface_id (rt, Beta_name);
+    assert (beta_id > 0);
+    assert (! y_Runtime_is_sealed (rt));
+
+    y_Runtime_seal (rt);
+    assert (y_Runtime_is_sealed (rt));
+
+    /* Registered classes and interfaces are still there */
+    y_Error * error = NULL;
+    Gamma * gamma = Gamma_new (rt, &error);
+    assert (gamma && ! error);
+    assert (y_Runtime_get_interface_id (rt, Beta_name) == beta_id);
+    assert (y_get_implementation_of (gamma, &Beta_interface));
+    assert (Beta_do_action (gamma) == Gamma_default);
+    y_unref (gamma);
+}
+
+void
+test_sealed_registration ()
+{
+    printf ("Test registering in a sealed runtime (%d)\n", __LINE__);
+
+    /* No new interfaces */
+    assert (y_Runtime_get_interface_id (rt, "late") == 0);
+    assert (y_Runtime_register_interface (rt, &late_interface) == 0);
+    assert (y_Runtime_find_interface (rt, &late_interface) == 0);
+
+    /* No new classes: creating an instance fails */
+    y_Error * error = NULL;
+    assert (Zeta_type (rt) == NULL);
+    Zeta * zeta = Zeta_new (rt, &error);
+    assert (zeta == NULL);
+    assert (error);
+    assert (y_Error_get_code (error) == APR_EINVAL);
+    y_unref (error);
+}
+
+/* A class whose initialisation seals its runtime, before it declares the 
+ * interfaces it implements */
+y_TypeSlot late_class = 0;
+int late_beta_impl;
+
+void
+late_init_type (y_Runtime * rt, void * type, void * super_type)
+{
+    y_InterfaceSpec interface_specs[] = {
+        { "late", &late_beta_impl },
+        { Beta_name, &late_beta_impl },
+        { NULL, }
+    };
+
+    y_Runtime_seal (rt);
+    y_implement_interfaces (rt, type, interface_specs);
+}
+
+void
+test_class_init_across_seal ()
+{
+    printf ("Test initialising a class while the runtime is sealed (%d)\n",
+            __LINE__);
+
+    y_Runtime * late_rt = y_Runtime_new (NULL, NULL, 16, true);
+    int beta_id = y_Runtime_get_interface_id (late_rt, Beta_name);
+    y_ObjectClass * type = y_Runtime_init_type (late_rt, "Late",
+            sizeof (y_ObjectClass), y_Object_type (late_rt), late_init_type,
+            &late_class);
+
+    /* Claimed before the seal: initialised, but without the new interface */
+    assert (y_Runtime_is_sealed (late_rt));
+    assert (type && type->interfaces);
+    assert (type->interfaces->size == 1);
+    assert (! (type->interfaces->implements & 1));
+
+    y_Error * error = NULL;
+    void * late = y_create (late_rt, type, &error);
+    assert (late && ! error);
+    assert (y_get_implementation (late, beta_id) == &late_beta_impl);
+    assert (y_get_implementation (late, 0) == NULL);
+    assert (y_get_implementation_by_name (late, "late") == NULL);
+    y_unref (late);
+
+    y_Runtime_destroy (late_rt);
+}
+
+int
+main ()
+{
+    setup ();
+
+    test_seal ();
+    test_sealed_registration ();
+    test_class_init_across_seal ();
+
+    teardown ();
+    return 0;
+}
@@ -0,0 +1,166 @@
+/**
+ * Test suite: thread-safety policies.
+ *
+ * Classes declare how their instances may be shared between threads.  Shared 
+ * instances (the default) are locked and reference counted atomically; 
+ * confined instances, which never leave the thread that created them, pay for 
+ * neither.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <yakka/Yakka.h>
+#include <yakka/Object-protected.h>
+#include <test/ootest/Alpha-protected.h>
+#include <test/ootest/Epsilon.h>
+
+y_Runtime * rt;
+
+/* An immutable Alpha: its value is set by its initialisation method */
+typedef struct Iota {
+    Alpha       alpha;
+} Iota;
+
+typedef struct IotaProtected {
+    AlphaProtected      alpha;
+} IotaProtected;
+
+typedef struct IotaClass {
+    AlphaClass      alpha;
+} IotaClass;
+
+void
+Iota_init (void * self, y_Error ** error)
+{
+    ((Alpha *)self)->a = 5;
+}
+
+y_DEFINE_CLASS (Iota, Alpha, Iota_init, NULL, NULL, y_TYPE_IMMUTABLE)
+
+void setup ()
+{
+    apr_status_t apr_status;
+
+    apr_status = apr_initialize ();
+    if ( apr_status != APR_SUCCESS )
+        abort ();
+
+    rt = y_Runtime_new (NULL, NULL, 1024, true);
+    assert (rt);
+}
+
+void
+teardown ()
+{
+    y_Runtime_destroy (rt);
+    apr_terminate ();
+}
+
+void
+test_policy_inheritance ()
+{
+    printf ("Test that classes inherit or declare a thread-safety "
+            "policy (%d)\n", __LINE__);
+
+    y_ObjectClass * object_type = y_Object_type (rt);
+    y_ObjectClass * alpha_type = (y_ObjectClass *)Alpha_type (rt);
+    y_ObjectClass * epsilon_type = (y_ObjectClass *)Epsilon_type (rt);
+
+    assert ((object_type->flags & y_TYPE_THREAD_POLICY) == y_TYPE_SHARED);
+    /* Alpha declares nothing: inherited from Object */
+    assert ((alpha_type->flags & y_TYPE_THREAD_POLICY) == y_TYPE_SHARED);
+    /* Epsilon declares itself confined */
+    assert ((epsilon_type->flags & y_TYPE_THREAD_POLICY) == y_TYPE_CONFINED);
+}
+
+void
+test_shared_instance ()
+{
+    printf ("Test that a shared instance is locked and atomically "
+            "reference counted (%d)\n", __LINE__);
+
+    Alpha * alpha = Alpha_new (rt, 1, NULL);
+
+    assert (alpha);
+    assert (y_OBJECT_PROTECTED (alpha)->mutex);
+    assert (y_OBJECT_PROTECTED (alpha)->atomic_refcount);
+
+    assert (y_ref (alpha) == alpha);
+    y_unref (alpha);
+    y_unref (alpha);
+}
+
+void
+test_confined_instance ()
+{
+    printf ("Test that a confined instance has no mutex and a plain "
+            "reference count (%d)\n", __LINE__);
+
+    y_Error * error = NULL;
+    Epsilon * epsilon = Epsilon_new (rt, 42, &error);
+
+    assert (! error);
+    assert (epsilon);
+    assert (! y_OBJECT_PROTECTED (epsilon)->mutex);
+    assert (! y_OBJECT_PROTECTED (epsilon)->atomic_refcount);
+
+    /* Still an Alpha, and still usable by its own thread */
+    assert (Alpha_get (ALPHA (epsilon)) == 42);
+    y_lock (epsilon);
+    y_unlock (epsilon);
+    assert (y_ref (epsilon) == epsilon);
+    y_unref (epsilon);
+
+    /* Copies are confined too */
+    Epsilon * copy = y_copy (epsilon, &error);
+    assert (! error);
+    assert (copy);
+    assert (! y_OBJECT_PROTECTED (copy)->mutex);
+    assert (Alpha_get (ALPHA (copy)) == 42);
+
+    y_unref (copy);
+    y_unref (epsilon);
+}
+
+void
+test_immutable_instance ()
+{
+    printf ("Test that an immutable instance is frozen once "
+            "constructed (%d)\n", __LINE__);
+
+    y_Error * error = NULL;
+    Alpha * iota = y_create (rt, Iota_type (rt), &error);
+
+    assert (! error);
+    assert (iota);
+    assert (! y_OBJECT_PROTECTED (iota)->mutex);
+    assert (y_OBJECT_PROTECTED (iota)->atomic_refcount);
+    assert (y_is_frozen (iota));
+    assert (Alpha_get (iota) == 5);
+
+    /* Not writable, so not locked */
+    Alpha_set (iota, 6, &error);
+    assert (error);
+    y_unref (error);
+    assert (Alpha_get (iota) == 5);
+    assert (y_try_lock (iota));
+    y_unlock (iota);
+    assert (y_OBJECT_PROTECTED (iota)->lock_depth == 0);
+    assert (! (y_read_begin (iota) & 1));
+
+    y_unref (iota);
+}
+
+int
+main ()
+{
+    setup ();
+
+    test_policy_inheritance ();
+    test_shared_instance ();
+    test_confined_instance ();
+    test_immutable_instance ();
+
+    teardown ();
+    return 0;
+}
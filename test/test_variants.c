@@ -0,0 +1,103 @@
+/**
+ * Test suite: build variants.
+ *
+ * This suite is built with the unchecked and single-threaded variants 
+ * together: casts are not checked, and objects are never locked, even in a 
+ * runtime that asks for thread safety.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <yakka/Yakka.h>
+
+y_Runtime * rt;
+
+void setup ()
+{
+    apr_status_t apr_status;
+
+    apr_status = apr_initialize ();
+    if ( apr_status != APR_SUCCESS )
+        abort ();
+
+    rt = y_Runtime_new (NULL, NULL, 1024, true);
+    assert (rt);
+}
+
+void
+teardown ()
+{
+    y_Runtime_destroy (rt);
+    apr_terminate ();
+}
+
+#ifdef y_UNCHECKED
+/* Cast an object as an error, without the assertion that stands in for the 
+ * type check (as in a build of the unchecked variant with NDEBUG) */
+#define NDEBUG
+#include <assert.h>
+static y_Error *
+cast_as_error (void * obj)
+{
+    return y_ERROR (obj);
+}
+#undef NDEBUG
+#include <assert.h>
+#endif /* y_UNCHECKED */
+
+void
+test_unchecked_cast ()
+{
+    printf ("Test casting without checks (%d)\n", __LINE__);
+
+    y_Error * error = NULL;
+    y_Object * obj = y_Object_new (rt, &error);
+    void * nothing = NULL;
+
+    assert (obj);
+    assert (y_OBJECT (obj) == obj);
+    assert (y_OBJECT (nothing) == NULL);
+#ifdef y_UNCHECKED
+    /* A wrong type goes unnoticed: a checked cast would return NULL */
+    assert (! y_is_a (obj, y_Error_type (rt)));
+    assert ((void *)cast_as_error (obj) == (void *)obj);
+#endif /* y_UNCHECKED */
+
+    y_unref (obj);
+}
+
+void
+test_single_threaded ()
+{
+    printf ("Test a runtime without locking (%d)\n", __LINE__);
+
+    y_Error * error = NULL;
+    y_Object * obj = y_Object_new (rt, &error);
+
+    assert (! y_HAS_THREADS);
+    assert (! y_Runtime_is_threadsafe (rt));
+
+    /* Locking is a no-op, so it can't be contended */
+    y_lock (obj);
+    assert (y_try_lock (obj));
+    y_unlock (obj);
+    y_unlock (obj);
+    assert (! y_wait (obj, 0));
+    assert (y_Runtime_get_lock_contention (rt) == 0);
+
+    assert (y_ref (obj) == obj);
+    y_unref (obj);
+    y_unref (obj);
+}
+
+int
+main ()
+{
+    setup ();
+
+    test_unchecked_cast ();
+    test_single_threaded ();
+
+    teardown ();
+    return 0;
+}
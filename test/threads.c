@@ -0,0 +1,27 @@
+#include <assert.h>
+#include "threads.h"
+
+void
+run_threads (int count, apr_thread_start_t func, void * data)
+{
+    apr_thread_t ** threads;
+    TestThread * args;
+    apr_pool_t * pool;
+    apr_status_t status;
+    int i;
+
+    apr_pool_create (&pool, NULL);
+    threads = apr_pcalloc (pool, count * sizeof (apr_thread_t *));
+    args = apr_pcalloc (pool, count * sizeof (TestThread));
+    for ( i = 0; i < count; i++ ) {
+        args[i].index = i;
+        args[i].data = data;
+        assert (apr_thread_create (&threads[i], NULL, func, &args[i],
+                    pool) == APR_SUCCESS);
+    }
+    for ( i = 0; i < count; i++ ) {
+        assert (apr_thread_join (&status, threads[i]) == APR_SUCCESS);
+        assert (status == APR_SUCCESS);
+    }
+    apr_pool_destroy (pool);
+}
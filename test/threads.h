@@ -0,0 +1,26 @@
+#ifndef THREADS_H_
+#define THREADS_H_
+
+#include <apr_thread_proc.h>
+
+/**
+ * What each thread started by run_threads is passed.
+ */
+typedef struct TestThread {
+    /** The index of the thread, from 0. */
+    int    index;
+    /** The data shared by the threads. */
+    void * data;
+} TestThread;
+
+/**
+ * Run a function in several threads at once, and wait for them all to finish.
+ * Each thread must exit with APR_SUCCESS.
+ *
+ * @param  count  The number of threads.
+ * @param  func  The function, passed a TestThread.
+ * @param  data  The data shared by the threads (TestThread::data).
+ */
+void run_threads (int count, apr_thread_start_t func, void * data);
+
+#endif
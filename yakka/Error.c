@@ -4,7 +4,7 @@
 #define ERRORSTR_SIZE 256
 
 static const char * error_type_name = "y_ErrorClass";
-static y_ErrorClass * error_class;
+static y_TypeSlot error_class = 0;
 
 void
 y_Error_throw (y_Runtime * rt, y_Error ** error, 
@@ -37,10 +37,8 @@ y_Error_throw (y_Runtime * rt, y_Error ** error,
     if ( description ) {
         protect->description = apr_pstrdup (pool, description);
     }
-    if ( * error ) {
-        /* Replace existing error with this one */
-        protect->cause = *error;
-    }
+    /* Replace existing error (if any) with this one, taking its reference */
+    protect->cause = y_move (error);
     *error = new_error;
 }
 
@@ -125,7 +123,8 @@ y_Error_init_type (y_Runtime * rt, void * type, void * super_type)
             sizeof (y_ErrorProtected),
             NULL,
             NULL,
-            y_Error_clear
+            y_Error_clear,
+            0
             );
 }
 
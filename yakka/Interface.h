@@ -19,6 +19,12 @@
  * @{
  */
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+struct y_Runtime;
+
 /**
  * Structure to contain an interface specification.
  *
@@ -32,23 +38,78 @@ typedef struct y_InterfaceSpec {
     void * vtable;
 } y_InterfaceSpec;
 
+/**
+ * An entry of a packed set of interfaces: an interface implemented by a class.
+ */
+typedef struct y_InterfaceEntry {
+    /** The identifier of the interface (0 if the entry is unused). */
+    int     id;
+    /** The implementation of the interface, as a vtable. */
+    void  * vtable;
+} y_InterfaceEntry;
+
+/** The number of bits of y_Interfaces::implements. */
+#define y_INTERFACE_BITS  64
+
 /**
  * Packed set of interfaces.
  *
- * This structure is used internally by classes that implement an interface.
+ * This structure is used internally by classes that implement an interface.  
+ * Its size depends only on the number of interfaces the class implements, not 
+ * on the number of interfaces registered.
  */
 typedef struct y_Interfaces {
     /**
-     * Array of interface vtables, indexed by interface identifier.  Sparse: 
-     * any unimplemented interfaces will be NULL.
+     * Bit (ID % @ref y_INTERFACE_BITS) is set for each implemented interface, 
+     * so most unimplemented interfaces are rejected without a probe.
      */
-    void ** vtables;
+    uint64_t           implements;
     /**
-     * The size of the interfaces member, as a number of elements.
+     * Hash table of the implemented interfaces, indexed by interface 
+     * identifier (modulo its size, a power of two, with linear probing).  At 
+     * most half full, so there is always an unused entry to end a probe.
      */
-    int     size;
+    y_InterfaceEntry * entries;
+    /**
+     * The size of the table minus one (a mask for the index).
+     */
+    int                mask;
+    /**
+     * The number of interfaces implemented.
+     */
+    int                size;
 } y_Interfaces;
 
+/**
+ * Look up the implementation of an interface in a packed set of interfaces.
+ *
+ * @param  interfaces  A packed set of interfaces, or NULL.
+ * @param  interface_id  The identifier of an interface.
+ * @return  The implementation of the interface, or NULL if it is not in the 
+ * set.
+ */
+static inline void *
+y_Interfaces_lookup (const y_Interfaces * interfaces, int interface_id)
+{
+    const y_InterfaceEntry * entry;
+    int i;
+
+    if ( ! interfaces || interface_id <= 0 || ! (interfaces->implements &
+                ((uint64_t)1 << (interface_id % y_INTERFACE_BITS))) ) {
+        return NULL;
+    }
+    for ( i = interface_id & interfaces->mask; ;
+            i = (i + 1) & interfaces->mask ) {
+        entry = &(interfaces->entries[i]);
+        if ( entry->id == interface_id ) {
+            return entry->vtable;
+        }
+        if ( ! entry->id ) {
+            return NULL;
+        }
+    }
+}
+
 /**
  * Retrieve the implementation of an interface from an object instance.
  *
@@ -66,5 +127,241 @@ typedef struct y_Interfaces {
                      iface_name)))) ?                                       \
       (iface_type *)y_get_implementation (instance, iface_id) : NULL )
 
+/**
+ * Static descriptor of an interface (see @ref y_DEFINE_INTERFACE).
+ *
+ * A descriptor stands for its interface in place of the name, so that the 
+ * interface's identifier is looked up once per runtime (when the interface is 
+ * registered with it) rather than on every use.  Identifiers differ between 
+ * runtimes, so each runtime caches them in a table of its own, indexed by the 
+ * descriptor's slot.
+ */
+typedef struct y_InterfaceDesc {
+    /** The name of the interface. */
+    const char *  name;
+    /** The index of the descriptor in the tables of the runtimes, shared by 
+     * all runtimes; 0 until first registered (@ref 
+     * y_Runtime_register_interface). */
+    _Atomic int   slot;
+} y_InterfaceDesc;
+
+#if defined (__GNUC__) && defined (__ELF__)
+/** Defined if interface descriptors are collected in a linker section. */
+#define y_HAVE_INTERFACE_SECTION  1
+/** Attributes that place a pointer in the linker section of interface 
+ * descriptors. */
+#define y_INTERFACE_SECTION  \
+    __attribute__ ((section ("y_interfaces"), used))
+
+extern y_InterfaceDesc * const __start_y_interfaces[] __attribute__ ((weak));
+extern y_InterfaceDesc * const __stop_y_interfaces[] __attribute__ ((weak));
+#endif /* __GNUC__ && __ELF__ */
+
+/**
+ * Define the descriptor of an interface.
+ *
+ * Where supported (GCC and ELF), a pointer to the descriptor is also placed in 
+ * the "y_interfaces" linker section, so that all of a module's interfaces can 
+ * be registered together, with dense identifiers, by @ref 
+ * y_REGISTER_INTERFACES.  A descriptor that is not registered that way is 
+ * registered when it is first used.
+ *
+ * @param  desc  The name of the descriptor variable.
+ * @param  iface_name  The string name of the interface.
+ */
+#ifdef y_HAVE_INTERFACE_SECTION
+#define y_DEFINE_INTERFACE(desc, iface_name)                                \
+    y_InterfaceDesc desc = { iface_name, 0 };                               \
+    static y_InterfaceDesc * const desc##_section_entry                     \
+        y_INTERFACE_SECTION = &desc
+#else
+#define y_DEFINE_INTERFACE(desc, iface_name)                                \
+    y_InterfaceDesc desc = { iface_name, 0 }
+#endif /* y_HAVE_INTERFACE_SECTION */
+
+/**
+ * Register all the interfaces defined (@ref y_DEFINE_INTERFACE) in the module 
+ * (executable or shared library) that invokes this macro, for example when the 
+ * module starts up.
+ *
+ * @param  rt  The Yakka runtime.
+ */
+#ifdef y_HAVE_INTERFACE_SECTION
+#define y_REGISTER_INTERFACES(rt)                                           \
+    y_Runtime_register_interfaces (rt, __start_y_interfaces,                \
+            __stop_y_interfaces)
+#else
+#define y_REGISTER_INTERFACES(rt)  ((void)(rt))
+#endif /* y_HAVE_INTERFACE_SECTION */
+
+/**
+ * Retrieve the implementation of an interface from an object instance, by the 
+ * interface's descriptor.
+ *
+ * @param  instance  An instance object that may implement the interface.
+ * @param  iface_type  The struct type of the interface.
+ * @param  desc  The descriptor of the interface (@ref y_DEFINE_INTERFACE).
+ * @return  The vtable via which the instance's type implements the interface, 
+ * or NULL if it does not.
+ */
+#define y_GET_VTABLE(instance, iface_type, desc)                            \
+    ( (instance) ? (iface_type *)y_get_implementation_of (instance, &(desc)) \
+      : NULL )
+
+/**
+ * Reference to an object as an implementation of an interface: the object, 
+ * with its class's implementation already looked up.
+ *
+ * Code that calls an interface's methods on the same object many times (or 
+ * holds the object to call them later, as containers and callback 
+ * registrations do) can keep an interface reference, and call through its 
+ * vtable directly:
+ *
+ * @code
+ * y_IfaceRef beta = y_IfaceRef_ref (y_as_interface (obj, &Beta_interface));
+ * ...
+ * y_IFACE_VTABLE (beta, Beta)->do_action (beta.obj);
+ * ...
+ * y_IfaceRef_unref (&beta);
+ * @endcode
+ */
+typedef struct y_IfaceRef {
+    /** The object (NULL if the reference is not set). */
+    void       * obj;
+    /** The object's implementation of the interface. */
+    const void * vtable;
+} y_IfaceRef;
+
+/** Initialiser of an interface reference that is not set. */
+#define y_IFACE_REF_INIT  { NULL, NULL }
+
+/**
+ * Whether an interface reference is set.
+ */
+#define y_IfaceRef_is_set(iref)  ((iref).obj != NULL)
+
+/**
+ * The vtable of an interface reference.
+ *
+ * @param  iref  An interface reference (which must be set).
+ * @param  iface_type  The struct type of the interface.
+ */
+#define y_IFACE_VTABLE(iref, iface_type)  ((const iface_type *)(iref).vtable)
+
+/**
+ * Get an interface reference to an object, by the interface's descriptor.
+ *
+ * No reference to the object is acquired: use @ref y_IfaceRef_ref to keep the 
+ * result.
+ *
+ * @param  self  An object instance.
+ * @param  desc  The descriptor of an interface (@ref y_DEFINE_INTERFACE).
+ * @return  The interface reference, which is not set if the object is NULL or 
+ * does not implement the interface.
+ */
+y_IfaceRef y_as_interface (void * self, y_InterfaceDesc * desc);
+
+/**
+ * Acquire a reference to the object of an interface reference (see @ref 
+ * y_ref).
+ *
+ * @return  The interface reference.
+ */
+y_IfaceRef y_IfaceRef_ref (y_IfaceRef iref);
+
+/**
+ * Release the reference held by an interface reference (see @ref y_unref), and 
+ * unset it.
+ *
+ * @param  iref  The location of an interface reference.
+ */
+void y_IfaceRef_unref (y_IfaceRef * iref);
+
+/** The number of classes an inline cache (@ref y_InlineCache) remembers. */
+#define y_INLINE_CACHE_SIZE  4
+
+/**
+ * Inline cache of a call site that retrieves the implementation of an 
+ * interface (see @ref y_GET_CACHED_VTABLE): the classes of the instances seen 
+ * there, and their implementations.
+ *
+ * Each entry is filled once, by the first class it sees; later classes use the 
+ * next free entry, and once all are used the call site looks implementations 
+ * up as usual.  The entries are cleared when the runtime whose classes filled 
+ * them is destroyed.  The instances of another runtime's classes are looked up 
+ * as usual too, which is still cheap: the runtime caches the identifier of the 
+ * interface (see @ref y_Runtime_register_interface).
+ */
+typedef struct y_InlineCache {
+    /** The classes, or NULL for unused entries. */
+    const void * _Atomic  types[y_INLINE_CACHE_SIZE];
+    /** The implementations of the interface by each class (NULL if it doesn't 
+     * implement it). */
+    void                * vtables[y_INLINE_CACHE_SIZE];
+    /** The runtime whose classes fill the cache (NULL until the first fill). */
+    struct y_Runtime * _Atomic  rt;
+    /** The number of implementations found in the cache (counted if the call 
+     * site is instrumented: see @ref y_INSTRUMENT_INLINE_CACHES). */
+    atomic_ulong          hits;
+    /** The number of implementations looked up (likewise). */
+    atomic_ulong          misses;
+} y_InlineCache;
+
+/**
+ * Retrieve the implementation of an interface from an object instance, and 
+ * remember it in an inline cache.  This is the slow path of @ref 
+ * y_GET_CACHED_VTABLE.
+ *
+ * @param  cache  The inline cache of the call site.
+ * @param  self  An object instance.
+ * @param  desc  The descriptor of an interface.
+ * @param  count  Whether to update the counters of the cache.
+ * @return  The instance's implementation of the interface, or NULL if not 
+ * implemented.
+ */
+void * y_InlineCache_lookup (y_InlineCache * cache, const void * self,
+        y_InterfaceDesc * desc, bool count);
+
+/**
+ * Whether call sites update the counters of their inline caches (hits and 
+ * misses).  Define y_INSTRUMENT_INLINE_CACHES before including Yakka to turn 
+ * them on.
+ */
+#ifdef y_INSTRUMENT_INLINE_CACHES
+#define y_INLINE_CACHE_COUNTED  1
+#define y_INLINE_CACHE_HIT(cache, vtable)                                   \
+    ( atomic_fetch_add_explicit (&((cache).hits), 1, memory_order_relaxed), \
+      (vtable) )
+#else
+#define y_INLINE_CACHE_COUNTED  0
+#define y_INLINE_CACHE_HIT(cache, vtable)  (vtable)
+#endif /* y_INSTRUMENT_INLINE_CACHES */
+
+/**
+ * Retrieve the implementation of an interface from an object instance, using 
+ * an inline cache.
+ *
+ * When the instance is of the class first seen by the call site, as is usual, 
+ * this takes a single comparison; other classes are found in the rest of the 
+ * cache (@ref y_InlineCache_lookup).
+ *
+ * @param  instance  An instance object that may implement the interface.
+ * @param  iface_type  The struct type of the interface.
+ * @param  desc  The descriptor of the interface (@ref y_DEFINE_INTERFACE).
+ * @param  cache  The inline cache (@ref y_InlineCache) of the call site, a 
+ * static variable initialised to zero.
+ * @return  The vtable via which the instance's type implements the interface, 
+ * or NULL if it does not.
+ */
+#define y_GET_CACHED_VTABLE(instance, iface_type, desc, cache)              \
+    ( (instance) ?                                                          \
+      (iface_type *)(                                                       \
+          atomic_load_explicit (&((cache).types[0]),                        \
+              memory_order_acquire) == ((y_Object *)(instance))->type ?     \
+          y_INLINE_CACHE_HIT (cache, (cache).vtables[0]) :                  \
+          y_InlineCache_lookup (&(cache), instance, &(desc),                \
+              y_INLINE_CACHE_COUNTED) )                                     \
+      : NULL )
+
 /** @} */
 #endif
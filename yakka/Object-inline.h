@@ -0,0 +1,162 @@
+#ifndef YAKKA_OBJECT_INLINE_H_
+#define YAKKA_OBJECT_INLINE_H_
+
+/**
+ * @addtogroup Object
+ * @{
+ *      @defgroup ObjectInline  Inline fast paths of Object
+ *      @{
+ *
+ * Inline versions of the core object operations, for code that calls them in
+ * loops.  Each handles the common case in the caller, and otherwise calls the
+ * corresponding function of the library (which remains the only
+ * implementation of destruction, weak references etc.), so the two may be
+ * mixed freely.
+ *
+ * Unlike the library functions, the fast paths do not check that their
+ * argument is an object: it must be an object or NULL.
+ */
+
+#include "Object-protected.h"
+
+/**
+ * Check whether the current thread owns the (still biased) reference count of
+ * an object.
+ *
+ * @param  obj  An object.
+ * @param  word  The object's shared reference count, as last read.
+ */
+static inline bool
+y_is_refcount_owner (const y_Object * obj, unsigned int word)
+{
+    y_ThreadRefs * owner = obj->protect->owner_refs;
+
+    return ( owner && ! (word & y_REFCOUNT_MERGED) &&
+            atomic_load_explicit (&(owner->thread), memory_order_relaxed) ==
+            &y_current_thread );
+}
+
+/**
+ * Check that an object may be used by the current thread: instances of a 
+ * confined class may only be used by the thread that created them.
+ */
+static inline bool
+y_is_accessible_inline (const y_Object * obj)
+{
+#if y_HAS_THREADS
+    return ( obj->protect->policy != y_TYPE_CONFINED ||
+            apr_os_thread_equal (obj->protect->owner,
+                apr_os_thread_current ()) );
+#else
+    return true;
+#endif /* y_HAS_THREADS */
+}
+
+/**
+ * Inline version of @ref y_get_runtime.
+ */
+static inline struct y_Runtime *
+y_get_runtime_inline (const void * self)
+{
+    return ( self ? ((const y_Object *)self)->protect->rt : NULL );
+}
+
+/**
+ * Inline version of @ref y_is_a: compares the instance's class with a final 
+ * type, or else checks the display of the instance's class, unless the 
+ * expected type is too deep to be recorded there.
+ */
+static inline bool
+y_is_a_inline (const void * self, const void * type)
+{
+    const y_ObjectClass * expected = (const y_ObjectClass *)type;
+
+    if ( ! (self && expected) ) {
+        return y_is_a (self, type);
+    }
+    const y_ObjectClass * actual = TYPE_AS_OBJECT (self);
+    if ( actual == expected || (expected->flags & y_TYPE_FINAL) ) {
+        return ( actual == expected );
+    }
+    if ( expected->depth >= y_TYPE_DISPLAY_SIZE ) {
+        return y_is_a (self, type);
+    }
+    return ( actual->depth >= expected->depth &&
+            actual->display[expected->depth] == expected );
+}
+
+/**
+ * Inline version of @ref y_get_implementation.
+ */
+static inline void *
+y_get_implementation_inline (const void * self, int interface_id)
+{
+    return y_Interfaces_lookup (TYPE_AS_OBJECT (self)->interfaces,
+            interface_id);
+}
+
+/**
+ * Inline version of @ref y_ref: the owner of a biased reference count, or the
+ * only user of a plain one, acquires the reference without a call.
+ */
+static inline void *
+y_ref_inline (void * self)
+{
+    y_Object * obj = (y_Object *)self;
+
+    if ( obj && ! atomic_load_explicit (&(obj->protect->weak_ref),
+                memory_order_relaxed) ) {
+        unsigned int word = atomic_load_explicit (&(obj->protect->refcount),
+                memory_order_relaxed);
+
+        assert (y_is_accessible_inline (obj));
+        assert (! obj->protect->retired_epoch);
+        if ( y_is_refcount_owner (obj, word) ) {
+            obj->protect->local_refcount++;
+            return obj;
+        }
+        if ( ! obj->protect->atomic_refcount && y_REFCOUNT_COUNT (word) > 0 ) {
+            atomic_store_explicit (&(obj->protect->refcount),
+                    word + y_REFCOUNT_ONE, memory_order_relaxed);
+            return obj;
+        }
+    }
+    return y_ref (self);
+}
+
+/**
+ * Inline version of @ref y_unref: a reference that is not the last is released
+ * without a call, as for @ref y_ref_inline.
+ */
+static inline void
+y_unref_inline (void * self)
+{
+    y_Object * obj = (y_Object *)self;
+
+    if ( obj && ! atomic_load_explicit (&(obj->protect->weak_ref),
+                memory_order_relaxed) ) {
+        unsigned int word = atomic_load_explicit (&(obj->protect->refcount),
+                memory_order_relaxed);
+
+        assert (y_is_accessible_inline (obj));
+        if ( y_is_refcount_owner (obj, word) ) {
+            if ( obj->protect->local_refcount > 1 ) {
+                obj->protect->local_refcount--;
+                return;
+            }
+        }
+        else if ( ! obj->protect->atomic_refcount &&
+                y_REFCOUNT_COUNT (word) > 1 ) {
+            atomic_store_explicit (&(obj->protect->refcount),
+                    word - y_REFCOUNT_ONE, memory_order_relaxed);
+            return;
+        }
+    }
+    y_unref (self);
+}
+
+/**
+ *      @}
+ * @}
+ */
+#endif
@@ -13,11 +13,155 @@
 #include "Error.h"
 #include "Interface.h"
 #include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
+#include <apr_portable.h>
 #include <assert.h>
+#include <stdatomic.h>
 
 struct y_ObjectClass;
 struct y_WeakRef;
 
+/**
+ * Thread-safety policy flags for a class (see @ref y_init_type).
+ *
+ * The policy determines what an instance of the class pays for thread safety 
+ * in a threadsafe runtime (@ref y_Runtime_new).  A class declares at most one 
+ * policy; if it declares none, it has the policy of its super class.  Object 
+ * is shared.
+ *
+ * The policy only applies when the runtime is threadsafe.  Otherwise no 
+ * instance has a mutex or an atomic reference count.
+ */
+enum {
+    /** Instances may be used by any thread: each has a mutex for locking, and 
+     * its reference count is updated atomically. */
+    y_TYPE_SHARED           = 1 << 0,
+    /** Instances are only used by the thread that created them: they have no 
+     * mutex and their reference count is not atomic.  Unless assertions are 
+     * disabled, using one from another thread aborts. */
+    y_TYPE_CONFINED         = 1 << 1,
+    /** Instances are not modified after construction, so they may be read by 
+     * any thread without locking: they have no mutex, but their reference 
+     * count is updated atomically because they may still be shared.  @ref 
+     * y_create freezes them (see @ref y_freeze) once the initialisation 
+     * methods have run, so their members must be set by those. */
+    y_TYPE_IMMUTABLE        = 1 << 2,
+    /** Mask of the thread-safety policy flags. */
+    y_TYPE_THREAD_POLICY    = y_TYPE_SHARED | y_TYPE_CONFINED | y_TYPE_IMMUTABLE
+};
+
+/**
+ * Other flags for a class (see @ref y_init_type).  Unlike the thread-safety 
+ * policy, they are not inherited.
+ */
+enum {
+    /** The class may not be subclassed: an instance is of the class only if it 
+     * is exactly of that class, so @ref y_is_a compares a single pointer.  
+     * Initialising a subclass fails, and so does creating instances of it. */
+    y_TYPE_FINAL            = 1 << 3
+};
+
+/**
+ * Storage class of the library's thread-local variables.  The single-threaded 
+ * variant uses the initial-exec model where supported, so that access is as 
+ * cheap as for a global; the other variants keep the default model, as that 
+ * model would stop the shared library from being loaded with dlopen.
+ */
+#if defined (__GNUC__) && defined (y_SINGLE_THREADED)
+#define y_THREAD_LOCAL  __thread __attribute__ ((tls_model ("initial-exec")))
+#else
+#define y_THREAD_LOCAL  _Thread_local
+#endif
+
+/**
+ * A variable that exists for each thread, so that its address identifies the 
+ * current thread.
+ */
+extern y_THREAD_LOCAL char y_current_thread;
+
+/**
+ * Reference counting state of a thread, for the objects it creates.
+ *
+ * The reference count of an atomically counted object is biased towards the 
+ * thread that created it (its owner), which is usually the thread that 
+ * references it most.  The owner keeps a plain, local count; other threads 
+ * update the shared count atomically.  When the owner releases its last 
+ * reference the two counts are merged, and from then on every thread uses the 
+ * shared count.  If other threads release references that the owner acquired 
+ * (so the shared count goes negative), the object may no longer be referenced 
+ * at all; it is queued here, for the owner to merge its counts.
+ */
+typedef struct y_ThreadRefs {
+    /** The thread (the address of its @ref y_current_thread), or NULL once it 
+     * has exited. */
+    const char * _Atomic       thread;
+    /** Objects queued for the owner to merge, linked via 
+     * y_ObjectProtected::next_queued. */
+    struct y_Object * _Atomic  queue;
+    /** Whether the thread has exited.  Its local counts can no longer change, 
+     * so any thread may then merge its queued objects. */
+    atomic_bool                exited;
+    /** The number of borrow scopes (@ref y_BORROW) the thread has open. */
+    unsigned int               borrow_depth;
+    /** The runtime's epoch when the thread opened its outermost borrow scope, 
+     * or 0 if it has none open. */
+    atomic_ulong               borrow_epoch;
+    /** The number of objects whose counts are still biased towards the thread 
+     * (or queued for it), plus the threads merging its queue.  Once the thread 
+     * has exited and this drops to zero, nothing refers to the state, and the 
+     * runtime gives it to the next new thread. */
+    atomic_uint                holders;
+    /** The pool for the class structures the thread initialises (see @ref 
+     * y_Runtime_get_global_pool), or NULL until it initialises one. */
+    apr_pool_t               * type_pool;
+    /** The next thread in the runtime's list. */
+    struct y_ThreadRefs      * next;
+} y_ThreadRefs;
+
+/** Flag of y_ObjectProtected::refcount: the owner's local count has been 
+ * merged into the shared count, which is the only count. */
+#define y_REFCOUNT_MERGED   1u
+/** Flag of y_ObjectProtected::refcount: the object is queued for its owner to 
+ * merge (and must not be destroyed until it has been). */
+#define y_REFCOUNT_QUEUED   2u
+/** Flag of y_ObjectProtected::refcount: the object is hot (see @ref 
+ * y_make_shared_hot), so part of its count is held in its shards. */
+#define y_REFCOUNT_HOT      4u
+/** A single reference, as counted by y_ObjectProtected::refcount. */
+#define y_REFCOUNT_ONE      8u
+/** The (signed) count held in y_ObjectProtected::refcount. */
+#define y_REFCOUNT_COUNT(word)  ((int)((word) & ~7u) / 8)
+
+/** The number of shards of the reference count of a hot object. */
+#define y_REF_SHARDS        16
+
+/**
+ * A shard of the reference count of a hot object: the references acquired by 
+ * the threads that use this shard, and not yet released by them.  Each shard 
+ * has a cache line of its own, so that threads using different shards do not 
+ * contend.
+ */
+typedef struct y_RefShard {
+    /** The count, in units of 2, plus @ref y_REF_SHARD_DEAD. */
+    atomic_uint  count;
+    /** Padding to the size of a cache line. */
+    char         padding[64 - sizeof (atomic_uint)];
+} y_RefShard;
+
+/** Flag of y_RefShard::count: the shard is not in use, because its count has 
+ * been folded into the shared count. */
+#define y_REF_SHARD_DEAD    1u
+
+/** Values of y_ObjectProtected::hot_state. */
+enum {
+    /** The reference count is not sharded. */
+    y_REFS_COLD             = 0,
+    /** The reference count is sharded. */
+    y_REFS_HOT,
+    /** The reference count is changing between the two. */
+    y_REFS_SWITCHING
+};
+
 /**
  * Object: the top-level instance in the Yakka type system.
  *
@@ -29,14 +173,58 @@ typedef struct y_ObjectProtected {
     struct y_Runtime         * rt;
     /** The pool for this instance. */
     apr_pool_t               * pool;
-    /** The mutex for this instance (NULL if threads are not enabled). */
+    /** The mutex for this instance (NULL if threads are not enabled, or the 
+     * class is not shared). */
     apr_thread_mutex_t       * mutex;
-    /** The number of references to this instance being held elsewhere. */
-    int                        refcount;
+    /** The condition variable for waiting on this instance as a monitor 
+     * (created by the first @ref y_wait). */
+    apr_thread_cond_t        * cond;
+    /** The number of threads waiting on this instance (guarded by the mutex). 
+     */
+    unsigned int               waiters;
+    /** The number of times the lock is held by its holder (it may be locked 
+     * again while held, e.g. by a setter during y_assign). */
+    unsigned int               lock_depth;
+    /** The shared count of references to this instance being held elsewhere, 
+     * in units of @ref y_REFCOUNT_ONE, plus flags (@ref y_REFCOUNT_MERGED, 
+     * @ref y_REFCOUNT_QUEUED). */
+    atomic_uint                refcount;
+    /** Whether the reference count must be updated atomically. */
+    bool                       atomic_refcount;
+    /** The owner's local count of references, until it is merged. */
+    unsigned int               local_refcount;
+    /** The reference counting state of the owner (NULL if the count is not 
+     * biased towards an owner). */
+    y_ThreadRefs             * owner_refs;
+    /** The next object in the owner's queue of objects to merge, or in the 
+     * runtime's list of objects to destroy once borrowing ends. */
+    struct y_Object          * next_queued;
+    /** The runtime's epoch when the object was released while borrowing was 
+     * in progress (see @ref y_Runtime_defer_destroy), or 0. */
+    unsigned long              retired_epoch;
+    /** Whether the reference count is sharded (@ref y_REFS_COLD, @ref 
+     * y_REFS_HOT or @ref y_REFS_SWITCHING). */
+    atomic_int                 hot_state;
+    /** The shards of the reference count (NULL until the object is first made 
+     * hot). */
+    y_RefShard               * ref_shards;
+    /** The thread-safety policy of the instance's class (e.g. @ref 
+     * y_TYPE_SHARED). */
+    unsigned int               policy;
+#if APR_HAS_THREADS
+    /** The thread that created this instance (unused by the single-threaded 
+     * variant, which keeps it so that the layout is the same). */
+    apr_os_thread_t            owner;
+#endif /* APR_HAS_THREADS */
     /** The weak reference to this instance, if it exists; otherwise NULL. */
-    struct y_WeakRef         * weak_ref;
+    struct y_WeakRef * _Atomic weak_ref;
     /** Whether this object is in the process of being deleted. */
     bool                       deleted;
+    /** Whether this object is frozen (see @ref y_freeze). */
+    atomic_bool                frozen;
+    /** Write sequence number, for optimistic reads: odd while the object is 
+     * locked for writing (see @ref y_read_begin). */
+    atomic_uint                version;
 } y_ObjectProtected;
 
 /**
@@ -120,6 +308,13 @@ typedef struct y_ClearMethodList {
     } * methods;
 } y_ClearMethodList;
 
+/**
+ * The number of ancestors of a class recorded in its display (see 
+ * y_ObjectClass::display).  Deeper ancestors are found by walking the super 
+ * classes.
+ */
+#define y_TYPE_DISPLAY_SIZE  8
+
 /**
  * The class structure for Object.
  */
@@ -136,6 +331,15 @@ typedef struct y_ObjectClass {
     size_t               instance_size;  /* Size of an instance */
     /** The size of the protected instance struct. */
     size_t               protected_size;   /* Size of the protected data structure */
+    /** Flags describing the class, such as its thread-safety policy (@ref 
+     * y_TYPE_SHARED etc.). */
+    unsigned int         flags;
+    /** The depth of the class in the hierarchy (0 for Object). */
+    unsigned int         depth;
+    /** The display of the class: its ancestors (including itself) indexed by 
+     * depth, so that y_is_a checks a single entry.  Only the first @ref 
+     * y_TYPE_DISPLAY_SIZE are recorded. */
+    struct y_ObjectClass * display[y_TYPE_DISPLAY_SIZE];
 
     /** List of initialisation methods for this class. */
     y_InitMethodList   * init;
@@ -172,12 +376,190 @@ typedef struct y_ObjectClass {
  * specific assignment is required.)
  * @param  clear_method  A clear method, to be added to the chain of clear 
  * methods (NULL if no specific clear is required.)
+ * @param  flags  Flags describing the class: a thread-safety policy (@ref 
+ * y_TYPE_SHARED, @ref y_TYPE_CONFINED or @ref y_TYPE_IMMUTABLE), or 0 to use 
+ * the policy of the super class, possibly with @ref y_TYPE_FINAL.
  */
 void y_init_type (y_Runtime * rt, void * type, void * super_type, const char * name, 
         size_t class_size, size_t instance_size, size_t protected_size,
         void   (* init_method  ) (void * self, y_Error ** error),
         void * (* assign_method) (void * to, const void * from, y_Error ** error),
-        void   (* clear_method ) (void * self, bool unref_objects));
+        void   (* clear_method ) (void * self, bool unref_objects),
+        unsigned int flags);
+
+/**
+ * Declare the interfaces that a class implements, in addition to those of its 
+ * super class, or overriding them.
+ *
+ * This is called after @ref y_init_type (which gives the class its super 
+ * class's interfaces).  The class's implementations are merged into a single 
+ * table once, so finding an implementation costs the same however deep the 
+ * class is in the hierarchy.
+ *
+ * @param  rt  The Yakka Runtime.
+ * @param  type  The type being initialised.
+ * @param  specs  A NULL-terminated list of interface specifications (see @ref 
+ * y_Runtime_pack_interfaces).
+ */
+void y_implement_interfaces (y_Runtime * rt, void * type,
+        y_InterfaceSpec * specs);
+
+/**
+ * An interface implemented by a class defined with @ref y_DEFINE_CLASS.
+ */
+typedef struct y_ClassInterface {
+    /** The descriptor of the interface (NULL for the unused first entry). */
+    y_InterfaceDesc * desc;
+    /** The implementation of the interface, as a (usually static) vtable. */
+    const void      * vtable;
+} y_ClassInterface;
+
+/**
+ * Static descriptor of a class (see @ref y_DEFINE_CLASS): everything needed to 
+ * initialise its class structure, which is known at compile time.
+ */
+typedef struct y_ClassDesc {
+    /** The human-readable name of the class. */
+    const char             * name;
+    /** The size of the class struct. */
+    size_t                   class_size;
+    /** The size of the public instance struct. */
+    size_t                   instance_size;
+    /** The size of the protected instance struct. */
+    size_t                   protected_size;
+    /** Get the super class. */
+    void                  * (* get_super) (y_Runtime * rt);
+    /** Initialisation method (see @ref y_init_type), or NULL. */
+    void                    (* init_method) (void * self, y_Error ** error);
+    /** Assignment method, or NULL. */
+    void                  * (* assign_method) (void * to, const void * from,
+            y_Error ** error);
+    /** Clear method, or NULL. */
+    void                    (* clear_method) (void * self, bool unref_objects);
+    /** Flags describing the class (see @ref y_init_type). */
+    unsigned int             flags;
+    /** The interfaces that the class adds to or overrides in its super 
+     * class. */
+    const y_ClassInterface * interfaces;
+    /** The number of interfaces. */
+    size_t                   interface_count;
+    /** The slot of the class in each runtime (see @ref y_TypeSlot). */
+    y_TypeSlot             * type_slot;
+} y_ClassDesc;
+
+/**
+ * Initialise a class structure from a class descriptor.  This is the 
+ * initialisation method that @ref y_Runtime_init_class passes to @ref 
+ * y_Runtime_init_type.
+ */
+void y_init_class (y_Runtime * rt, void * type, void * super_type,
+        const y_ClassDesc * desc);
+
+/**
+ * Get the class structure described by a class descriptor, initialising it if 
+ * required.  Once initialised, the class structure is returned without 
+ * locking.
+ */
+void * y_class_type (y_Runtime * rt, const y_ClassDesc * desc);
+
+#if defined (__GNUC__) && defined (__ELF__)
+/** Defined if class descriptors are collected in a linker section. */
+#define y_HAVE_CLASS_SECTION  1
+
+extern const y_ClassDesc * const __start_y_classes[] __attribute__ ((weak));
+extern const y_ClassDesc * const __stop_y_classes[] __attribute__ ((weak));
+#endif /* __GNUC__ && __ELF__ */
+
+/**
+ * Define a class declaratively.
+ *
+ * The class's structs are expected to be named Name (instance), NameClass and 
+ * NameProtected, and its super class's type accessor Super_type.  This defines 
+ * a constant class descriptor (Name_class_desc) in static storage, and the 
+ * type accessor Name_type, which initialises the class structure on first 
+ * use.  Where supported (GCC and ELF), the descriptor is also placed in the 
+ * "y_classes" linker section, so that @ref y_REGISTER_CLASSES initialises all 
+ * of a module's classes at startup.
+ *
+ * A class whose class struct has further members to set (e.g. virtual 
+ * methods) must be initialised by @ref y_init_type instead.
+ *
+ * @param  Name  The name of the class.
+ * @param  Super  The name of the super class (y_Object for Object).
+ * @param  init  An initialisation method, or NULL.
+ * @param  assign  An assign method, or NULL.
+ * @param  clear  A clear method, or NULL.
+ * @param  flags  Flags describing the class (see @ref y_init_type).
+ * @param  ...  The interfaces that the class implements, in addition to or 
+ * overriding those of its super class, as { &descriptor, vtable } pairs.
+ */
+#define y_DEFINE_CLASS(Name, Super, init, assign, clear, flags, ...)        \
+    static y_TypeSlot Name##_class_slot = 0;                                \
+    static const y_ClassInterface Name##_class_interfaces[] =               \
+        { { NULL, NULL }, __VA_ARGS__ };                                    \
+    const y_ClassDesc Name##_class_desc = {                                 \
+        #Name,                                                              \
+        sizeof (Name##Class),                                               \
+        sizeof (Name),                                                      \
+        sizeof (Name##Protected),                                           \
+        (void * (*) (y_Runtime *))Super##_type,                             \
+        init,                                                               \
+        assign,                                                             \
+        clear,                                                              \
+        flags,                                                              \
+        Name##_class_interfaces + 1,                                        \
+        sizeof (Name##_class_interfaces) / sizeof (y_ClassInterface) - 1,   \
+        &Name##_class_slot                                                  \
+    };                                                                      \
+    y_CLASS_SECTION_ENTRY (Name)                                            \
+    Name##Class *                                                           \
+    Name##_type (y_Runtime * rt)                                            \
+    {                                                                       \
+        return (Name##Class *)y_class_type (rt, &Name##_class_desc);        \
+    }
+
+#ifdef y_HAVE_CLASS_SECTION
+#define y_CLASS_SECTION_ENTRY(Name)                                         \
+    static const y_ClassDesc * const Name##_class_section_entry             \
+        __attribute__ ((section ("y_classes"), used)) = &Name##_class_desc;
+#else
+#define y_CLASS_SECTION_ENTRY(Name)
+#endif /* y_HAVE_CLASS_SECTION */
+
+/**
+ * Initialise all the classes defined (@ref y_DEFINE_CLASS) in the module 
+ * (executable or shared library) that invokes this macro, for example when the 
+ * module starts up.  Their type accessors then never need to lock the 
+ * runtime.
+ *
+ * @param  rt  The Yakka runtime.
+ */
+#ifdef y_HAVE_CLASS_SECTION
+#define y_REGISTER_CLASSES(rt)                                              \
+    y_Runtime_register_classes (rt, __start_y_classes, __stop_y_classes)
+#else
+#define y_REGISTER_CLASSES(rt)  ((void)(rt))
+#endif /* y_HAVE_CLASS_SECTION */
+
+/**
+ * Initialise the classes of an array of class descriptors, such as the linker 
+ * section of a module (see @ref y_REGISTER_CLASSES).
+ *
+ * @param  start  The first descriptor (may be NULL if there are none).
+ * @param  end  The end of the array.
+ */
+void y_Runtime_register_classes (y_Runtime * rt,
+        const y_ClassDesc * const * start, const y_ClassDesc * const * end);
+
+/**
+ * Merge the reference counts of the objects queued by other threads for the 
+ * owner thread, destroying any that are no longer referenced.
+ *
+ * This must be called by the owner thread, unless it has exited.
+ *
+ * @param  refs  The reference counting state of the owner thread.
+ */
+void y_ThreadRefs_merge_queue (y_ThreadRefs * refs);
 
 /**
  * No-arg constructor for a given type.
@@ -185,6 +567,16 @@ void y_init_type (y_Runtime * rt, void * type, void * super_type, const char * n
 void * y_create (struct y_Runtime * rt, const void * class_type,
         struct y_Error ** error);
 
+/**
+ * No-arg constructor for the type with a given name (see @ref 
+ * y_Runtime_find_type).
+ *
+ * @return  The new instance, or NULL (with an APR_EINVAL error) if there is no 
+ * such type, or type_name is NULL.
+ */
+void * y_create_by_name (struct y_Runtime * rt, const char * type_name,
+        struct y_Error ** error);
+
 /**
  * Get the type of an instance, cast as a particular class. 
  *
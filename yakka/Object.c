@@ -1,11 +1,20 @@
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <assert.h>
-#include "Object-protected.h"
+#include "Object-inline.h"
 #include "Runtime.h"
 #include "WeakRef-protected.h"
+#define APR_WANT_MEMFUNC
+#include <apr_want.h>
 
 static const char * object_type_name = "Object";
-static y_ObjectClass * object_class = NULL;
+static y_TypeSlot object_class = 0;
+
+/* The reference count shard used by the current thread, plus one (zero until 
+ * the thread first uses a hot object).  Threads are assigned shards in turn. */
+static y_THREAD_LOCAL unsigned int current_ref_shard = 0;
+static atomic_uint ref_shards_assigned = 0;
 
 void y_Object_clear (void * self, bool unref_objects);
 void y_clear_object (void * self, bool unref_objects);
@@ -23,18 +32,32 @@ bool
 y_is_a (const void * instance, const void * expected_type)
 {
     y_ObjectClass * actual_type = NULL;
-    bool match = false;
+    const y_ObjectClass * expected = (const y_ObjectClass *)expected_type;
+    unsigned int depth;
 
     if ( !(instance && expected_type && 
                 (actual_type = (((y_Object *)instance)->type))) ) {
         return false;
     }
 
-    while ( actual_type && !match) {
-        match = (actual_type == expected_type);
+    if ( actual_type == expected ) {
+        return true;  /* The exact type: the usual case of a cast */
+    }
+    if ( expected->flags & y_TYPE_FINAL ) {
+        return false;  /* Can't have sub types */
+    }
+    depth = expected->depth;
+    if ( actual_type->depth < depth ) {
+        return false;  /* Too shallow to be a sub type */
+    }
+    if ( depth < y_TYPE_DISPLAY_SIZE ) {
+        return ( actual_type->display[depth] == expected );
+    }
+    /* Beyond the display: find the ancestor at that depth */
+    while ( actual_type->depth > depth ) {
         actual_type = actual_type->super;
     }
-    return match;
+    return ( actual_type == expected );
 }
 
 void
@@ -57,12 +80,34 @@ y_cleanup_of_last_resort (void * data)
 {
     y_Object * obj = y_OBJECT (data);
     if ( obj && !obj->protect->deleted ) {
+        atomic_store (&(obj->protect->frozen), false);  /* No longer shared */
         y_clear_object (obj, false);  /* false: too late for full cleanup */
         obj->protect->deleted = true;
     }
     return APR_SUCCESS;
 }
 
+void *
+y_create_by_name (y_Runtime * rt, const char * type_name, y_Error ** error)
+{
+    void * class_type = y_Runtime_find_type (rt, type_name);
+
+    if ( ! type_name ) {
+        y_Error_throw (rt, error, __FILE__, __LINE__, APR_EINVAL,
+                "No class name");
+        return NULL;
+    }
+    if ( ! class_type ) {
+        char description[128];
+        snprintf (description, sizeof (description), "No such class: %s",
+                type_name);
+        y_Error_throw (rt, error, __FILE__, __LINE__, APR_EINVAL,
+                description);
+        return NULL;
+    }
+    return y_create (rt, class_type, error);
+}
+
 void *
 y_create (y_Runtime *rt, const void * class_type,
         y_Error ** error)
@@ -70,6 +115,13 @@ y_create (y_Runtime *rt, const void * class_type,
     y_Object * obj = NULL;
     apr_pool_t * pool = NULL;
 
+    if ( ! class_type ) {
+        /* Not registered before the runtime was sealed, or a subclass of a 
+         * final class */
+        y_Error_throw (rt, error, __FILE__, __LINE__, APR_EINVAL,
+                "Cannot create an instance: the class is not initialised");
+        return NULL;
+    }
     pool = y_Runtime_create_object_pool (rt, error);
     if ( error && *error )
         goto cleanup;
@@ -80,18 +132,40 @@ y_create (y_Runtime *rt, const void * class_type,
     obj->protect->rt = rt;
     obj->protect->pool = pool;
 
-#if APR_HAS_THREADS
+    obj->protect->policy = ((y_ObjectClass *)class_type)->flags &
+        y_TYPE_THREAD_POLICY;
+#if y_HAS_THREADS
+    obj->protect->owner = apr_os_thread_current ();
     if ( y_Runtime_is_threadsafe (rt) ) {
-        if ( y_Error_throw_apr (rt, error, __FILE__, __LINE__,
-                    apr_thread_mutex_create (&(obj->protect->mutex),
-                        APR_THREAD_MUTEX_DEFAULT, pool)) )
-            goto cleanup;
-        apr_pool_cleanup_register (pool, obj->protect->mutex,
-                (apr_status_t (*)(void *))apr_thread_mutex_destroy, NULL);
+        if ( obj->protect->policy == y_TYPE_SHARED ) {
+            if ( y_Error_throw_apr (rt, error, __FILE__, __LINE__,
+                        apr_thread_mutex_create (&(obj->protect->mutex),
+                            APR_THREAD_MUTEX_NESTED, pool)) )
+                goto cleanup;
+            apr_pool_cleanup_register (pool, obj->protect->mutex,
+                    (apr_status_t (*)(void *))apr_thread_mutex_destroy, NULL);
+        }
+        obj->protect->atomic_refcount =
+            ( obj->protect->policy != y_TYPE_CONFINED );
     }    
-#endif /* APR_HAS_THREADS */
-    obj->protect->refcount = 1;
+#endif /* y_HAS_THREADS */
+    if ( obj->protect->atomic_refcount ) {
+        /* Biased: the creating thread holds the first reference locally */
+        y_ThreadRefs * refs = y_Runtime_get_thread_refs (rt);
+        if ( atomic_load_explicit (&(refs->queue), memory_order_relaxed) ) {
+            y_ThreadRefs_merge_queue (refs);
+        }
+        atomic_fetch_add_explicit (&(refs->holders), 1, memory_order_relaxed);
+        obj->protect->owner_refs = refs;
+        obj->protect->local_refcount = 1;
+        atomic_init (&(obj->protect->refcount), 0);
+    }
+    else {
+        atomic_init (&(obj->protect->refcount),
+                y_REFCOUNT_ONE | y_REFCOUNT_MERGED);
+    }
     obj->protect->weak_ref = NULL;
+    atomic_init (&(obj->protect->frozen), false);
 
     y_InitMethodList * init = ((y_ObjectClass *)class_type)->init;
 
@@ -109,21 +183,31 @@ y_create (y_Runtime *rt, const void * class_type,
         }
     }
     obj->type = (void *)class_type;
+    if ( obj->protect->policy == y_TYPE_IMMUTABLE ) {
+        /* Constructed: no writers from now on (nor locking) */
+        atomic_store_explicit (&(obj->protect->frozen), true,
+                memory_order_release);
+    }
     apr_pool_cleanup_register (pool, obj, y_cleanup_of_last_resort, NULL);
 
     return obj;
 
 /* Failure: just delete underlying pool and return NULL */
 cleanup:
+    if ( obj && obj->protect->owner_refs )
+        atomic_fetch_sub_explicit (&(obj->protect->owner_refs->holders), 1,
+                memory_order_release);
     if ( pool )
-        y_Runtime_free_object_pool (obj->protect->rt, obj->protect->pool);
+        y_Runtime_free_object_pool (rt, pool);
     return NULL;
 }
 
 void
 y_clear (void * self)
 {
-    y_clear_object (self, true);
+    if ( ! y_is_frozen (self) ) {
+        y_clear_object (self, true);
+    }
 }
 
 void
@@ -156,13 +240,19 @@ y_assign (void *to, const void *from,
     bool failed = false;
     void * result = NULL;
 
-    if ( (! to) || (! from) )
+    if ( (! to) || (! from) || y_is_frozen (to) )
         return NULL;
 
     y_ObjectClass * type = ((y_Object *)to)->type;
     y_AssignMethodList * assign = type->assign;
 
     if ( assign && ((y_Object *)to)->type == ((y_Object *)from)->type ) {
+        /* Neither object may change while the assignment is in progress */
+        void * objects[] = { to, (void *)from };
+        bool threadsafe = y_Runtime_is_threadsafe (y_get_runtime (to));
+        if ( threadsafe ) {
+            y_lock_many (objects, 2);
+        }
         y_clear_object (to, true);
         int i;
         for ( i = 0; i < assign->size; i++ ) {
@@ -178,6 +268,9 @@ y_assign (void *to, const void *from,
         }
         y_bless (to, type);
         y_bless (from, type);
+        if ( threadsafe ) {
+            y_unlock_many (objects, 2);
+        }
         if ( ! failed ) {
             result = to;
         }
@@ -192,6 +285,10 @@ y_copy (const void * self,
     const y_Object * obj = (const y_Object *)self;
     if ( ! obj )
         return NULL;
+    if ( y_is_frozen (obj) ) {
+        /* A copy would be indistinguishable */
+        return y_ref ((void *)obj);
+    }
     void * to = y_create (obj->protect->rt, obj->type, error);
     if ( error && *error )
         goto cleanup;
@@ -206,106 +303,946 @@ cleanup:
     return NULL;
 }
 
+/**
+ * Lock the mutex of an object, without marking the object as being written.
+ */
+static void
+y_lock_mutex (y_Object * obj)
+{
+#if y_HAS_THREADS
+    if ( obj && obj->protect->mutex ) {
+        apr_thread_mutex_lock (obj->protect->mutex);
+    }
+#endif /* y_HAS_THREADS */
+}
+
+/**
+ * Unlock the mutex of an object.
+ */
+static void
+y_unlock_mutex (y_Object * obj)
+{
+#if y_HAS_THREADS
+    if ( obj && obj->protect->mutex ) {
+        apr_thread_mutex_unlock (obj->protect->mutex);
+    }
+#endif /* y_HAS_THREADS */
+}
+
+/**
+ * Mark an object as being written (see y_read_begin): its version becomes odd.  
+ * The object's mutex must be held.
+ */
+static void
+y_begin_write (y_Object * obj)
+{
+    unsigned int version = atomic_load_explicit (&(obj->protect->version),
+            memory_order_relaxed);
+    atomic_store_explicit (&(obj->protect->version), version + 1,
+            memory_order_relaxed);
+    /* The version must be updated before any of the members */
+    atomic_thread_fence (memory_order_release);
+}
+
+/**
+ * Mark the write of an object as complete: its version becomes even again.
+ */
+static void
+y_end_write (y_Object * obj)
+{
+    unsigned int version = atomic_load_explicit (&(obj->protect->version),
+            memory_order_relaxed);
+    atomic_store_explicit (&(obj->protect->version), version + 1,
+            memory_order_release);
+}
+
+/**
+ * Lock an object for writing, unless it is frozen.  An object without a mutex 
+ * is only used by one thread, so it needs no locking, nor versions for readers.
+ *
+ * @return  True if the object was locked.
+ */
+static bool
+y_lock_object (y_Object * obj)
+{
+    if ( atomic_load_explicit (&(obj->protect->frozen),
+                memory_order_acquire) ) {
+        return false;
+    }
+    if ( ! obj->protect->mutex ) {
+        return true;
+    }
+    y_lock_mutex (obj);
+    if ( atomic_load_explicit (&(obj->protect->frozen),
+                memory_order_relaxed) ) {
+        /* Frozen while waiting for the lock */
+        y_unlock_mutex (obj);
+        return false;
+    }
+    if ( obj->protect->lock_depth++ == 0 ) {
+        y_begin_write (obj);
+    }
+    return true;
+}
+
 void
 y_lock (void * self)
 {
-#if APR_HAS_THREADS
     y_Object * obj = y_OBJECT (self);
-    
-    if ( obj && obj->protect->mutex ) {
-        apr_thread_mutex_lock (obj->protect->mutex);
+
+    if ( obj ) {
+        assert (y_is_accessible_inline (obj));
+        y_lock_object (obj);
     }
-#endif /* APR_HAS_THREADS */
+}
+
+bool
+y_lock_for_write (void * self)
+{
+    y_Object * obj = y_OBJECT (self);
+
+    if ( obj ) {
+        assert (y_is_accessible_inline (obj));
+        return y_lock_object (obj);
+    }
+    return false;
 }
 
 bool
 y_try_lock (void * self)
 {
     bool acquired = false;
-#if APR_HAS_THREADS
     y_Object * obj = y_OBJECT (self);
-        if ( obj ) {
-        apr_status_t status = apr_thread_mutex_trylock (obj->protect->mutex);
-        if ( ! APR_STATUS_IS_EBUSY (status)) {
-            acquired = true;
+
+    if ( obj ) {
+        assert (y_is_accessible_inline (obj));
+        if ( y_is_frozen (obj) || ! obj->protect->mutex ) {
+            return true;
+        }
+#if y_HAS_THREADS
+        acquired = ! APR_STATUS_IS_EBUSY (apr_thread_mutex_trylock (
+                    obj->protect->mutex));
+#endif /* y_HAS_THREADS */
+        if ( acquired && y_is_frozen (obj) ) {
+            /* Frozen while the lock was being taken */
+            y_unlock_mutex (obj);
+        }
+        else if ( acquired && obj->protect->lock_depth++ == 0 ) {
+            y_begin_write (obj);
         }
     }
-#endif /* APR_HAS_THREADS */
     return acquired;
 }
 
 void
 y_unlock (void * self)
 {
-#if APR_HAS_THREADS
     y_Object * obj = y_OBJECT (self);
 
-    if ( obj && obj->protect->mutex ) {
-        apr_thread_mutex_unlock (obj->protect->mutex);
+    if ( obj && ! y_is_frozen (obj) && obj->protect->mutex ) {
+        if ( --(obj->protect->lock_depth) == 0 ) {
+            y_end_write (obj);
+        }
+        y_unlock_mutex (obj);
     }
-#endif /* APR_HAS_THREADS */
 }
 
-void *
-y_ref (void * self)
+/**
+ * Find the object of an array that is next in the canonical locking order 
+ * (ascending address): the lowest address above a given object.
+ *
+ * @param  objects  An array of objects.
+ * @param  count  The number of entries in the array.
+ * @param  after  The object last locked, or NULL to find the first.
+ * @return  The next object to lock, or NULL if there are no more.
+ */
+static void *
+y_next_in_lock_order (void * const * objects, size_t count, const void * after)
 {
-    y_Object * obj = y_OBJECT (self);
-    if ( ! obj )
-        return NULL;
-    void * ref = NULL;
-    bool has_weak_ref = obj->protect->weak_ref;
+    void * next = NULL;
+    size_t i;
 
-    if ( obj->protect->refcount > 0 ) {
-        if ( has_weak_ref ) {
-            y_lock (obj->protect->weak_ref);
+    for ( i = 0; objects && i < count; i++ ) {
+        void * obj = objects[i];
+        if ( obj && (uintptr_t)obj > (uintptr_t)after &&
+                ( ! next || (uintptr_t)obj < (uintptr_t)next ) ) {
+            next = obj;
         }
-        y_lock (obj);
-        if ( obj->protect->refcount > 0 ) {  /* check again in case changed */
-            obj->protect->refcount += 1;
-            ref = obj;
+    }
+    return next;
+}
+
+void
+y_lock_many (void * const * objects, size_t count)
+{
+    void * obj = NULL;
+
+    while ( (obj = y_next_in_lock_order (objects, count, obj)) ) {
+        if ( ! y_try_lock (obj) ) {
+            y_Runtime_count_lock_contention (y_get_runtime (obj));
+            y_lock (obj);
         }
+    }
+}
+
+bool
+y_try_lock_many (void * const * objects, size_t count)
+{
+    void * obj = NULL;
+
+    while ( (obj = y_next_in_lock_order (objects, count, obj)) ) {
+        if ( ! y_try_lock (obj) ) {
+            void * locked = NULL;
+
+            /* Back off: release those locked so far */
+            y_Runtime_count_lock_contention (y_get_runtime (obj));
+            while ( (locked = y_next_in_lock_order (objects, count, locked)) !=
+                    obj ) {
+                y_unlock (locked);
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+y_unlock_many (void * const * objects, size_t count)
+{
+    void * obj = NULL;
+
+    while ( (obj = y_next_in_lock_order (objects, count, obj)) ) {
         y_unlock (obj);
-        if ( has_weak_ref ) {
-            y_unlock (obj->protect->weak_ref);
+    }
+}
+
+bool
+y_wait (void * self, apr_interval_time_t timeout)
+{
+    bool notified = false;
+
+#if y_HAS_THREADS
+    y_Object * obj = y_OBJECT (self);
+
+    if ( obj && obj->protect->mutex && ! y_is_frozen (obj) ) {
+        apr_status_t status = APR_SUCCESS;
+
+        if ( ! obj->protect->cond ) {
+            status = apr_thread_cond_create (&(obj->protect->cond),
+                    obj->protect->pool);
+        }
+        /* A nested lock would not be released while waiting */
+        assert (obj->protect->lock_depth == 1);
+        if ( status == APR_SUCCESS ) {
+            unsigned int depth = obj->protect->lock_depth;
+
+            obj->protect->waiters++;
+            /* The lock is released: whoever takes it next is the writer, and 
+             * readers need not wait for a write meanwhile */
+            obj->protect->lock_depth = 0;
+            y_end_write (obj);
+            if ( timeout < 0 ) {
+                status = apr_thread_cond_wait (obj->protect->cond,
+                        obj->protect->mutex);
+            }
+            else {
+                status = apr_thread_cond_timedwait (obj->protect->cond,
+                        obj->protect->mutex, timeout);
+            }
+            y_begin_write (obj);
+            obj->protect->lock_depth = depth;
+            obj->protect->waiters--;
+            notified = ( status == APR_SUCCESS );
         }
     }
-    return ref;
+#endif /* y_HAS_THREADS */
+    return notified;
 }
 
 void
-y_unref (void * self)
+y_notify (void * self)
 {
+#if y_HAS_THREADS
     y_Object * obj = y_OBJECT (self);
-    if ( ! obj )
-        return;
-    bool has_weak_ref = obj->protect->weak_ref;
-    bool do_cleanup = false;
 
+    /* Without waiters, there is nothing to signal */
+    if ( obj && obj->protect->waiters ) {
+        apr_thread_cond_signal (obj->protect->cond);
+    }
+#endif /* y_HAS_THREADS */
+}
+
+void
+y_notify_all (void * self)
+{
+#if y_HAS_THREADS
+    y_Object * obj = y_OBJECT (self);
+
+    if ( obj && obj->protect->waiters ) {
+        apr_thread_cond_broadcast (obj->protect->cond);
+    }
+#endif /* y_HAS_THREADS */
+}
+
+void
+y_freeze (void * self)
+{
+    y_Object * obj = y_OBJECT (self);
+
+    if ( obj && ! obj->protect->mutex ) {
+        atomic_store_explicit (&(obj->protect->frozen), true,
+                memory_order_release);
+    }
+    else if ( obj && y_lock_object (obj) ) {
+        /* Any writer has finished: from now on there are none */
+        atomic_store_explicit (&(obj->protect->frozen), true,
+                memory_order_release);
+        assert (obj->protect->lock_depth == 1);
+        obj->protect->lock_depth = 0;
+        y_end_write (obj);
+        y_unlock_mutex (obj);
+    }
+}
+
+bool
+y_is_frozen (const void * self)
+{
+    const y_Object * obj = (const y_Object *)self;
+
+    return ( obj && atomic_load_explicit (&(obj->protect->frozen),
+                memory_order_acquire) );
+}
+
+unsigned int
+y_read_begin (const void * self)
+{
+    const y_Object * obj = y_OBJECT (self);
+    unsigned int version = 0;
+
+    if ( obj ) {
+        /* Wait for any write in progress to complete */
+        while ( (version = atomic_load_explicit (&(obj->protect->version),
+                        memory_order_acquire)) & 1 ) {
+            ;
+        }
+    }
+    return version;
+}
+
+bool
+y_read_retry (const void * self, unsigned int version)
+{
+    const y_Object * obj = y_OBJECT (self);
+
+    if ( ! obj ) {
+        return false;
+    }
+    /* Members must be read before the version is checked again */
+    atomic_thread_fence (memory_order_acquire);
+    return ( atomic_load_explicit (&(obj->protect->version),
+                memory_order_relaxed) != version );
+}
+
+/**
+ * Update the current thread's shard of the reference count of a hot object.
+ *
+ * @param  obj  An object.
+ * @param  delta  The number of references to acquire (if positive) or release 
+ * (if negative).  References are only released through the shard if the shard 
+ * holds them all.
+ * @return  True if the shard was updated; false if the object is not hot (or 
+ * the shard holds too few references to release), and the shared count must be 
+ * updated instead.
+ */
+static bool
+y_refcount_shard_update (y_Object * obj, int delta)
+{
+    if ( atomic_load_explicit (&(obj->protect->hot_state),
+                memory_order_acquire) != y_REFS_HOT ) {
+        return false;
+    }
+    if ( ! current_ref_shard ) {
+        current_ref_shard = atomic_fetch_add_explicit (&ref_shards_assigned,
+                1, memory_order_relaxed) % y_REF_SHARDS + 1;
+    }
 
-    if ( obj->protect->refcount > 0 ) {
-        if ( has_weak_ref ) {
-            y_lock (obj->protect->weak_ref);
+    atomic_uint * count = &(obj->protect->ref_shards[current_ref_shard - 1].count);
+    unsigned int word = atomic_load_explicit (count, memory_order_relaxed);
+
+    do {
+        if ( (word & y_REF_SHARD_DEAD) || (int)(word / 2) + delta < 0 ) {
+            return false;
         }
-        y_lock (obj);
-        if ( obj->protect->refcount > 0 ) {  /* check again in case changed */
-            obj->protect->refcount -= 1;
-            if ( obj->protect->refcount == 0 ) {
-                do_cleanup = true;
+    } while ( ! atomic_compare_exchange_weak_explicit (count, &word,
+                word + 2 * delta, memory_order_acq_rel,
+                memory_order_relaxed) );
+    return true;
+}
+
+/**
+ * Release references of a hot object from any of its shards (those of other 
+ * threads included), as long as they hold some.
+ *
+ * @param  obj  An object.
+ * @param  n  The number of references to release.
+ * @return  The number of references that the shards could not release.
+ */
+static unsigned int
+y_refcount_shard_release (y_Object * obj, unsigned int n)
+{
+    int i;
+
+    for ( i = 0; n && i < y_REF_SHARDS; i++ ) {
+        atomic_uint * count = &(obj->protect->ref_shards[i].count);
+        unsigned int word = atomic_load_explicit (count, memory_order_relaxed);
+
+        while ( ! (word & y_REF_SHARD_DEAD) && word / 2 > 0 ) {
+            unsigned int taken = ( word / 2 < n ? word / 2 : n );
+
+            if ( atomic_compare_exchange_weak_explicit (count, &word,
+                        word - 2 * taken, memory_order_acq_rel,
+                        memory_order_relaxed) ) {
+                n -= taken;
+                break;
             }
         }
-        y_unlock (obj);
-        if ( has_weak_ref ) {
-            if ( do_cleanup ) {
-                y_WeakRef_unset (obj->protect->weak_ref);
+    }
+    return n;
+}
+
+/**
+ * Fold the shards of a hot object's reference count into its shared count, 
+ * making the object cold.
+ *
+ * Only one thread folds the shards; if another thread is already doing so, or 
+ * the object is not hot, nothing is done.
+ *
+ * @return  True if the object is no longer referenced, and should be 
+ * destroyed.
+ */
+static bool
+y_refcount_fold_shards (y_Object * obj)
+{
+    int state = y_REFS_HOT;
+    unsigned int sum = 0;
+    unsigned int word;
+    int i;
+
+    if ( ! atomic_compare_exchange_strong (&(obj->protect->hot_state), &state,
+                y_REFS_SWITCHING) ) {
+        return false;
+    }
+    /* A dead shard is not updated again: its references go to the shared 
+     * count, which stays hot (so cannot reach zero) until all are added up. */
+    for ( i = 0; i < y_REF_SHARDS; i++ ) {
+        sum += atomic_fetch_or_explicit (&(obj->protect->ref_shards[i].count),
+                y_REF_SHARD_DEAD, memory_order_acq_rel) / 2;
+    }
+    word = atomic_fetch_add_explicit (&(obj->protect->refcount),
+            sum * y_REFCOUNT_ONE - y_REFCOUNT_HOT, memory_order_acq_rel) +
+        sum * y_REFCOUNT_ONE - y_REFCOUNT_HOT;
+    atomic_store_explicit (&(obj->protect->hot_state), y_REFS_COLD,
+            memory_order_release);
+    return ( y_REFCOUNT_COUNT (word) == 0 );
+}
+
+/**
+ * Increase the reference count of an object.
+ *
+ * @param  obj  An object.
+ * @param  n  The number of references to acquire.
+ * @param  checked  If true, the caller does not necessarily hold a reference 
+ * already (e.g. it holds a weak reference), so the count is only increased if 
+ * the object is still referenced.
+ * @return  True if the references were acquired.
+ */
+static bool
+y_refcount_increment (y_Object * obj, unsigned int n, bool checked)
+{
+    atomic_uint * refcount = &(obj->protect->refcount);
+    unsigned int word = atomic_load_explicit (refcount, memory_order_relaxed);
+
+    if ( y_is_refcount_owner (obj, word) ) {
+        obj->protect->local_refcount += n;
+        return true;
+    }
+    if ( y_refcount_shard_update (obj, (int)n) ) {
+        return true;  /* Hot, so not released yet */
+    }
+    if ( ! obj->protect->atomic_refcount ) {
+        if ( y_REFCOUNT_COUNT (word) <= 0 ) {
+            return false;
+        }
+        atomic_store_explicit (refcount, word + n * y_REFCOUNT_ONE,
+                memory_order_relaxed);
+        return true;
+    }
+    if ( checked ) {
+        /* While the counts are biased, the owner still holds a reference */
+        do {
+            if ( (word & (y_REFCOUNT_MERGED | y_REFCOUNT_HOT)) ==
+                    y_REFCOUNT_MERGED && y_REFCOUNT_COUNT (word) <= 0 ) {
+                return false;
             }
-            y_unlock (obj->protect->weak_ref);
+        } while ( ! atomic_compare_exchange_weak_explicit (refcount, &word,
+                    word + n * y_REFCOUNT_ONE, memory_order_relaxed,
+                    memory_order_relaxed) );
+    }
+    else {
+        atomic_fetch_add_explicit (refcount, n * y_REFCOUNT_ONE,
+                memory_order_relaxed);
+    }
+    return true;
+}
+
+/**
+ * Merge the owner's local reference count of an object into the shared count.
+ *
+ * This must be called by the owner, or any thread once the owner has exited, 
+ * and only while the counts are still biased.
+ *
+ * @return  True if the object is no longer referenced, and should be 
+ * destroyed.
+ */
+static bool
+y_refcount_merge (y_Object * obj)
+{
+    unsigned int add = obj->protect->local_refcount * y_REFCOUNT_ONE +
+        y_REFCOUNT_MERGED;
+    unsigned int word;
+
+    obj->protect->local_refcount = 0;
+    word = atomic_fetch_add_explicit (&(obj->protect->refcount), add,
+            memory_order_acq_rel) + add;
+    if ( ! (word & y_REFCOUNT_QUEUED) ) {
+        /* Done with the owner's state (else, once dequeued) */
+        atomic_fetch_sub_explicit (&(obj->protect->owner_refs->holders), 1,
+                memory_order_release);
+    }
+    return ( y_REFCOUNT_COUNT (word) == 0 && ! (word & y_REFCOUNT_QUEUED) );
+}
+
+/**
+ * Queue an object for its owner to merge, after another thread has made its 
+ * shared count negative and set @ref y_REFCOUNT_QUEUED (in the same 
+ * transition, so that the owner can't destroy the object meanwhile).  Only 
+ * that thread queues the object.
+ *
+ * @param  obj  An object whose counts are biased.
+ * @return  True if the object was queued for an owner that has exited, in 
+ * which case the caller must merge the queue, then release its hold on the 
+ * owner's state (@ref y_ThreadRefs::holders).
+ */
+static bool
+y_refcount_queue (y_Object * obj)
+{
+    y_ThreadRefs * owner = obj->protect->owner_refs;
+    y_Object * next = NULL;
+
+    /* Until merged, the queued object keeps the state from being reused */
+    atomic_fetch_add_explicit (&(owner->holders), 1, memory_order_relaxed);
+    next = atomic_load_explicit (&(owner->queue), memory_order_relaxed);
+    do {
+        obj->protect->next_queued = next;
+    } while ( ! atomic_compare_exchange_weak_explicit (&(owner->queue),
+                &next, obj, memory_order_release, memory_order_relaxed) );
+    if ( atomic_load (&(owner->exited)) ) {
+        return true;
+    }
+    atomic_fetch_sub_explicit (&(owner->holders), 1, memory_order_release);
+    return false;
+}
+
+/**
+ * Decrease the reference count of an object.
+ *
+ * @param  obj  An object.
+ * @param  n  The number of references to release.
+ * @param  orphaned  Set to the reference counting state of the object's owner 
+ * if the object was queued for merging after the owner exited; the caller must 
+ * then merge that queue (@ref y_ThreadRefs_merge_queue), and release its hold 
+ * on the state.
+ * @return  True if the last reference was released, and the object should be 
+ * destroyed.
+ */
+static bool
+y_refcount_decrement (y_Object * obj, unsigned int n,
+        y_ThreadRefs ** orphaned)
+{
+    atomic_uint * refcount = &(obj->protect->refcount);
+    unsigned int word = atomic_load_explicit (refcount, memory_order_relaxed);
+
+    if ( y_is_refcount_owner (obj, word) ) {
+        unsigned int local = obj->protect->local_refcount;
+
+        if ( local > n ) {
+            obj->protect->local_refcount -= n;
+            return false;
         }
+        /* Release the local references, then any others from the merged 
+         * count */
+        obj->protect->local_refcount = 0;
+        bool released = y_refcount_merge (obj);
+        if ( released || n == local ) {
+            return released;
+        }
+        n -= local;
+        word = atomic_load_explicit (refcount, memory_order_relaxed);
+    }
+    if ( y_refcount_shard_update (obj, -(int)n) ) {
+        return false;
+    }
+    if ( (word & (y_REFCOUNT_MERGED | y_REFCOUNT_HOT)) == y_REFCOUNT_MERGED &&
+            y_REFCOUNT_COUNT (word) <= 0 ) {
+        return false;  /* Already released */
+    }
+    if ( ! obj->protect->atomic_refcount ) {
+        atomic_store_explicit (refcount, word - n * y_REFCOUNT_ONE,
+                memory_order_relaxed);
+        return ( y_REFCOUNT_COUNT (word) == (int)n );
+    }
+    if ( (word & y_REFCOUNT_HOT) && y_REFCOUNT_COUNT (word) <= (int)n ) {
+        /* Rather than empty the shared count (and fold the shards) while the 
+         * shards of other threads still hold references, release those */
+        n = y_refcount_shard_release (obj, n);
+        if ( ! n ) {
+            return false;
+        }
+        word = atomic_load_explicit (refcount, memory_order_relaxed);
     }
-    if ( do_cleanup ) {
+    /* Release this thread's writes to whoever destroys the object.  If the 
+     * counts are still biased and this makes the shared count negative, the 
+     * object is claimed for queueing in the same transition. */
+    unsigned int released;
+    bool queue;
+    do {
+        released = word - n * y_REFCOUNT_ONE;
+        queue = ( ! (word & (y_REFCOUNT_MERGED | y_REFCOUNT_QUEUED |
+                        y_REFCOUNT_HOT)) && y_REFCOUNT_COUNT (released) < 0 );
+        if ( queue ) {
+            released |= y_REFCOUNT_QUEUED;
+        }
+    } while ( ! atomic_compare_exchange_weak_explicit (refcount, &word,
+                released, memory_order_acq_rel, memory_order_relaxed) );
+    word = released;
+    if ( word & y_REFCOUNT_HOT ) {
+        /* The shards may hold the remaining references, or none */
+        return ( y_REFCOUNT_COUNT (word) <= 0 ?
+                y_refcount_fold_shards (obj) : false );
+    }
+    if ( word & y_REFCOUNT_MERGED ) {
+        return ( y_REFCOUNT_COUNT (word) == 0 &&
+                ! (word & y_REFCOUNT_QUEUED) );
+    }
+    if ( queue && y_refcount_queue (obj) ) {
+        *orphaned = obj->protect->owner_refs;
+    }
+    return false;
+}
+
+/**
+ * Destroy an object whose last reference has been released, unless objects are 
+ * being borrowed (@ref y_BORROW): then it is destroyed once borrowing ends.
+ */
+static void
+y_release (y_Object * obj)
+{
+    if ( ! y_Runtime_defer_destroy (obj->protect->rt, obj) ) {
         y_destroy (obj);
     }
 }
 
+void
+y_ThreadRefs_merge_queue (y_ThreadRefs * refs)
+{
+    y_Object * obj = atomic_exchange_explicit (&(refs->queue), NULL,
+            memory_order_acquire);
+    unsigned int merged = 0;
+
+    while ( obj ) {
+        y_Object * next = obj->protect->next_queued;
+        y_WeakRef * weak_ref = obj->protect->weak_ref;
+        unsigned int word;
+        bool do_cleanup;
+
+        if ( weak_ref ) {
+            y_lock (weak_ref);
+        }
+        word = atomic_load_explicit (&(obj->protect->refcount),
+                memory_order_relaxed);
+        if ( ! (word & y_REFCOUNT_MERGED) ) {
+            y_refcount_merge (obj);  /* Still queued: not destroyed yet */
+        }
+        word = atomic_fetch_and_explicit (&(obj->protect->refcount),
+                ~y_REFCOUNT_QUEUED, memory_order_acq_rel);
+        do_cleanup = ( y_REFCOUNT_COUNT (word) == 0 );
+        if ( weak_ref ) {
+            if ( do_cleanup ) {
+                y_WeakRef_unset (weak_ref);
+            }
+            y_unlock (weak_ref);
+        }
+        if ( do_cleanup ) {
+            y_release (obj);
+        }
+        merged++;
+        obj = next;
+    }
+    if ( merged ) {
+        atomic_fetch_sub_explicit (&(refs->holders), merged,
+                memory_order_release);
+    }
+}
+
+/**
+ * Acquire references to an object (see y_ref).
+ *
+ * @param  obj  An object (already checked to be one).
+ * @param  n  The number of references to acquire.
+ * @return  True if the references were acquired.
+ */
+static bool
+y_ref_object (y_Object * obj, unsigned int n)
+{
+    y_WeakRef * weak_ref = obj->protect->weak_ref;
+    bool acquired = false;
+
+    assert (y_is_accessible_inline (obj));
+    /* A borrowed reference must not be kept once the object is released */
+    assert (! obj->protect->retired_epoch);
+    /* With a weak reference, a reference may be acquired from another thread 
+     * at any time (y_WeakRef_deref); the lock orders that against the release 
+     * of the last reference. */
+    if ( weak_ref ) {
+        y_lock (weak_ref);
+    }
+    acquired = y_refcount_increment (obj, n, weak_ref != NULL);
+    if ( weak_ref ) {
+        y_unlock (weak_ref);
+    }
+    return acquired;
+}
+
+/**
+ * Release references to an object (see y_unref), without destroying it.
+ *
+ * @param  obj  An object (already checked to be one).
+ * @param  n  The number of references to release.
+ * @return  True if the last reference was released: the caller must destroy 
+ * the object (@ref y_release).
+ */
+static bool
+y_unref_object (y_Object * obj, unsigned int n)
+{
+    y_WeakRef * weak_ref = obj->protect->weak_ref;
+    y_ThreadRefs * orphaned = NULL;
+    bool do_cleanup = false;
+
+    assert (y_is_accessible_inline (obj));
+    if ( weak_ref ) {
+        y_lock (weak_ref);
+    }
+    do_cleanup = y_refcount_decrement (obj, n, &orphaned);
+    if ( weak_ref ) {
+        if ( do_cleanup ) {
+            y_WeakRef_unset (weak_ref);
+        }
+        y_unlock (weak_ref);
+    }
+    if ( orphaned ) {
+        y_ThreadRefs_merge_queue (orphaned);
+        atomic_fetch_sub_explicit (&(orphaned->holders), 1,
+                memory_order_release);
+    }
+    return do_cleanup;
+}
+
+void *
+y_ref (void * self)
+{
+    y_Object * obj = y_OBJECT (self);
+
+    return ( obj && y_ref_object (obj, 1) ? obj : NULL );
+}
+
+void
+y_unref (void * self)
+{
+    y_Object * obj = y_OBJECT (self);
+
+    if ( obj && y_unref_object (obj, 1) ) {
+        y_release (obj);
+    }
+}
+
+/**
+ * Get the next run of an array of objects: consecutive entries that are the 
+ * same object, and that has been checked to be an Object (or is NULL).
+ *
+ * @param  objects  An array of objects.
+ * @param  count  The number of entries in the array.
+ * @param  i  The index of the start of the run; advanced to the end of it.
+ * @param  checked_type  The type of the last object checked; updated if 
+ * another type is checked.
+ * @param  run  Set to the number of entries in the run.
+ * @return  The object, or NULL if the entries are not objects.
+ */
+static y_Object *
+y_next_run (void * const * objects, size_t count, size_t * i,
+        const void ** checked_type, unsigned int * run)
+{
+    y_Object * obj = (y_Object *)objects[*i];
+    size_t start = *i;
+
+    while ( ++(*i) < count && objects[*i] == obj ) {
+        ;
+    }
+    *run = (unsigned int)(*i - start);
+
+    if ( obj && obj->type != *checked_type ) {
+        /* Objects of a type already checked need not be checked again */
+        if ( ! y_OBJECT (obj) ) {
+            return NULL;
+        }
+        *checked_type = obj->type;
+    }
+    return obj;
+}
+
+void
+y_ref_many (void * const * objects, size_t count)
+{
+    const void * checked_type = NULL;
+    unsigned int run = 0;
+    size_t i = 0;
+
+    while ( objects && i < count ) {
+        y_Object * obj = y_next_run (objects, count, &i, &checked_type, &run);
+        if ( obj ) {
+            y_ref_object (obj, run);
+        }
+    }
+}
+
+void
+y_unref_many (void * const * objects, size_t count)
+{
+    const void * checked_type = NULL;
+    y_Object * released = NULL;
+    unsigned int run = 0;
+    size_t i = 0;
+
+    while ( objects && i < count ) {
+        y_Object * obj = y_next_run (objects, count, &i, &checked_type, &run);
+        if ( obj && y_unref_object (obj, run) ) {
+            /* No longer referenced (nor queued), so free to be linked */
+            obj->protect->next_queued = released;
+            released = obj;
+        }
+    }
+    while ( released ) {
+        y_Object * next = released->protect->next_queued;
+        y_release (released);
+        released = next;
+    }
+}
+
+void
+y_borrow_begin (const void * self)
+{
+    if ( self ) {
+        y_Runtime_borrow_begin (y_get_runtime (self));
+    }
+}
+
+void
+y_borrow_end (const void * self)
+{
+    if ( self ) {
+        y_Runtime_borrow_end (y_get_runtime (self));
+    }
+}
+
+void *
+y_move_ (void ** location)
+{
+    void * ref = NULL;
+
+    if ( location ) {
+        ref = *location;
+        *location = NULL;
+    }
+    return ref;
+}
+
+/**
+ * Free the shards of an object's reference count, with its pool.
+ */
+static apr_status_t
+y_free_ref_shards (void * data)
+{
+    free (data);
+    return APR_SUCCESS;
+}
+
+bool
+y_make_shared_hot (void * self)
+{
+    y_Object * obj = y_OBJECT (self);
+    if ( ! obj || ! obj->protect->atomic_refcount )
+        return false;
+    unsigned int word = atomic_load (&(obj->protect->refcount));
+    int state = y_REFS_COLD;
+    int i;
+
+    if ( ! (word & y_REFCOUNT_MERGED) ) {
+        if ( ! y_is_refcount_owner (obj, word) ) {
+            return false;
+        }
+        y_refcount_merge (obj);  /* The caller's reference remains */
+        if ( atomic_load (&(obj->protect->refcount)) & y_REFCOUNT_QUEUED ) {
+            return false;  /* Still to be merged by this thread */
+        }
+    }
+    if ( ! atomic_compare_exchange_strong (&(obj->protect->hot_state), &state,
+                y_REFS_SWITCHING) ) {
+        return ( state == y_REFS_HOT );
+    }
+    if ( ! obj->protect->ref_shards ) {
+        /* Allocated outside the lock, which only guards the pool */
+        y_RefShard * shards = calloc (y_REF_SHARDS, sizeof (y_RefShard));
+
+        if ( ! shards ) {
+            atomic_store (&(obj->protect->hot_state), y_REFS_COLD);
+            return false;
+        }
+        y_lock_mutex (obj);
+        apr_pool_cleanup_register (obj->protect->pool, shards,
+                y_free_ref_shards, apr_pool_cleanup_null);
+        y_unlock_mutex (obj);
+        obj->protect->ref_shards = shards;
+    }
+    atomic_fetch_add (&(obj->protect->refcount), y_REFCOUNT_HOT);
+    for ( i = 0; i < y_REF_SHARDS; i++ ) {
+        atomic_store_explicit (&(obj->protect->ref_shards[i].count), 0,
+                memory_order_relaxed);
+    }
+    atomic_store_explicit (&(obj->protect->hot_state), y_REFS_HOT,
+            memory_order_release);
+    return true;
+}
+
+void
+y_make_shared_cold (void * self)
+{
+    y_Object * obj = y_OBJECT (self);
+
+    if ( obj ) {
+        /* The caller's reference remains */
+        y_refcount_fold_shards (obj);
+    }
+}
+
 void *
 y_weak_ref (void * self)
 {
@@ -313,17 +1250,26 @@ y_weak_ref (void * self)
     if ( ! obj )
         return NULL;
     y_Error * error = NULL;
+    y_WeakRef * weak_ref = obj->protect->weak_ref;
 
-    if ( ! obj->protect->weak_ref ) {
-        y_lock (obj);
-        if ( ! obj->protect->weak_ref ) {
-            obj->protect->weak_ref = y_WeakRef_new (obj->protect->rt, obj, &error);
-            if ( error )
-                y_unref (error);
+    if ( ! weak_ref ) {
+        /* Not every object has a mutex, so the weak reference is installed 
+         * atomically; if another thread got there first, use theirs. */
+        y_WeakRef * new_ref = y_WeakRef_new (obj->protect->rt, obj, &error);
+        if ( error ) {
+            y_unref (error);
+        }
+        if ( new_ref ) {
+            if ( atomic_compare_exchange_strong (&(obj->protect->weak_ref),
+                        &weak_ref, new_ref) ) {
+                weak_ref = new_ref;
+            }
+            else {
+                y_unref (new_ref);
+            }
         }
-        y_unlock (obj);
     }
-    return y_ref (obj->protect->weak_ref);
+    return y_ref (weak_ref);
 }
 
 y_Runtime *
@@ -343,6 +1289,7 @@ y_destroy (void * self)
 {
     y_Object * obj = y_OBJECT (self);
     if ( obj && !obj->protect->deleted ) {
+        atomic_store (&(obj->protect->frozen), false);  /* No longer shared */
         y_clear_object (obj, true);
         obj->protect->deleted = true;
         y_Runtime_free_object_pool (obj->protect->rt, obj->protect->pool);
@@ -353,13 +1300,8 @@ void *
 y_get_implementation (const void * self, int interface_id)
 {
     y_ObjectClass * type = TYPE_AS_OBJECT (y_OBJECT (self));
-    void * implementation = NULL;
-
-    if ( type->interfaces && type->interfaces->size > interface_id ) {
-        implementation = type->interfaces->vtables[interface_id];
-    }
 
-    return implementation;
+    return y_Interfaces_lookup (type->interfaces, interface_id);
 }
 
 void *
@@ -376,22 +1318,126 @@ y_get_implementation_by_name (const void * self, const char * name)
     return impl;
 }
 
+void *
+y_get_implementation_of (const void * self, y_InterfaceDesc * desc)
+{
+    if ( ! (self && desc) ) {
+        return NULL;
+    }
+    return y_get_implementation (self,
+            y_Runtime_register_interface (y_get_runtime (self), desc));
+}
+
+y_IfaceRef
+y_as_interface (void * self, y_InterfaceDesc * desc)
+{
+    y_IfaceRef iref = y_IFACE_REF_INIT;
+
+    iref.vtable = y_get_implementation_of (self, desc);
+    if ( iref.vtable ) {
+        iref.obj = self;
+    }
+    return iref;
+}
+
+y_IfaceRef
+y_IfaceRef_ref (y_IfaceRef iref)
+{
+    if ( ! y_ref (iref.obj) ) {
+        iref.obj = NULL;
+        iref.vtable = NULL;
+    }
+    return iref;
+}
+
+void
+y_IfaceRef_unref (y_IfaceRef * iref)
+{
+    void * obj = iref->obj;
+
+    iref->obj = NULL;
+    iref->vtable = NULL;
+    y_unref (obj);
+}
+
+/** Marks an entry of an inline cache that is being filled. */
+#define y_INLINE_CACHE_FILLING  ((const void *)1)
+
+void *
+y_InlineCache_lookup (y_InlineCache * cache, const void * self,
+        y_InterfaceDesc * desc, bool count)
+{
+    const void * type = ((const y_Object *)self)->type;
+    const void * cached = NULL;
+    void * vtable;
+    int i;
+
+    for ( i = 0; i < y_INLINE_CACHE_SIZE; i++ ) {
+        cached = atomic_load_explicit (&(cache->types[i]),
+                memory_order_acquire);
+        if ( cached == type ) {
+            if ( count ) {
+                atomic_fetch_add_explicit (&(cache->hits), 1,
+                        memory_order_relaxed);
+            }
+            return cache->vtables[i];
+        }
+        if ( ! cached ) {
+            break;
+        }
+    }
+    if ( count ) {
+        atomic_fetch_add_explicit (&(cache->misses), 1, memory_order_relaxed);
+    }
+    vtable = y_get_implementation_of (self, desc);
+    /* Fill the first free entry, unless another thread is filling it */
+    if ( i < y_INLINE_CACHE_SIZE &&
+            y_Runtime_add_inline_cache (y_get_runtime (self), cache) &&
+            atomic_compare_exchange_strong (&(cache->types[i]), &cached,
+                y_INLINE_CACHE_FILLING) ) {
+        cache->vtables[i] = vtable;
+        atomic_store_explicit (&(cache->types[i]), type, memory_order_release);
+    }
+    return vtable;
+}
+
 void
 y_init_type (y_Runtime * rt, void * type, void * super_type, const char * name, 
         size_t class_size, size_t instance_size, size_t protected_size,
         void   (* init_method  ) (void * self, y_Error ** error),
         void * (* assign_method) (void * to, const void * from, y_Error ** error),
-        void   (* clear_method ) (void * self, bool unref_objects))
+        void   (* clear_method ) (void * self, bool unref_objects),
+        unsigned int flags)
 {
     y_ObjectClass * object_type = (y_ObjectClass *)type;
     y_ObjectClass * super_type_ = (y_ObjectClass *)super_type;
 
+    /* At most one thread-safety policy may be declared */
+    assert ( ((flags & y_TYPE_THREAD_POLICY) &
+                ((flags & y_TYPE_THREAD_POLICY) - 1)) == 0 );
+
     object_type->super = super_type;
     object_type->name = name;
     object_type->rt = rt;
     object_type->class_size = class_size;
     object_type->instance_size = instance_size;
     object_type->protected_size = protected_size;
+    if ( ! (flags & y_TYPE_THREAD_POLICY) ) {
+        /* Inherit the policy of the super class */
+        flags |= ( super_type_ ? super_type_->flags & y_TYPE_THREAD_POLICY :
+                y_TYPE_SHARED );
+    }
+    object_type->flags = flags;
+
+    /* The display: the super class's, plus this class */
+    object_type->depth = ( super_type_ ? super_type_->depth + 1 : 0 );
+    if ( super_type_ ) {
+        memcpy (object_type->display, super_type_->display,
+                sizeof (object_type->display));
+    }
+    if ( object_type->depth < y_TYPE_DISPLAY_SIZE ) {
+        object_type->display[object_type->depth] = object_type;
+    }
 
     if ( init_method ) {
         object_type->init = (y_InitMethodList *)y_MethodList_extend (
@@ -417,7 +1463,62 @@ y_init_type (y_Runtime * rt, void * type, void * super_type, const char * name,
                 clear_method
                 );
     }
-    /* TODO: interfaces */
+    /* The super class's interfaces, until the class adds its own */
+    object_type->interfaces = ( super_type_ ? super_type_->interfaces : NULL );
+}
+
+void
+y_implement_interfaces (y_Runtime * rt, void * type, y_InterfaceSpec * specs)
+{
+    y_ObjectClass * object_type = (y_ObjectClass *)type;
+    y_ObjectClass * super_type = (y_ObjectClass *)object_type->super;
+
+    object_type->interfaces = y_Runtime_merge_interfaces (rt,
+            ( super_type ? super_type->interfaces : NULL ), specs);
+}
+
+void
+y_init_class (y_Runtime * rt, void * type, void * super_type,
+        const y_ClassDesc * desc)
+{
+    y_init_type (rt, type, super_type, desc->name, desc->class_size,
+            desc->instance_size, desc->protected_size, desc->init_method,
+            desc->assign_method, desc->clear_method, desc->flags);
+    if ( desc->interface_count ) {
+        y_InterfaceSpec specs[desc->interface_count + 1];
+        size_t i;
+
+        for ( i = 0; i < desc->interface_count; i++ ) {
+            specs[i].name = (char *)desc->interfaces[i].desc->name;
+            specs[i].vtable = (void *)desc->interfaces[i].vtable;
+        }
+        specs[i].name = NULL;
+        y_implement_interfaces (rt, type, specs);
+    }
+}
+
+void *
+y_class_type (y_Runtime * rt, const y_ClassDesc * desc)
+{
+    void * type = y_Runtime_get_type (rt, desc->type_slot);
+
+    if ( ! type ) {
+        type = y_Runtime_init_class (rt, desc);
+    }
+    return type;
+}
+
+void
+y_Runtime_register_classes (y_Runtime * rt,
+        const y_ClassDesc * const * start, const y_ClassDesc * const * end)
+{
+    const y_ClassDesc * const * desc;
+
+    for ( desc = start; desc && desc < end; desc++ ) {
+        if ( *desc ) {
+            y_class_type (rt, *desc);
+        }
+    }
 }
 
 void
@@ -433,23 +1534,26 @@ y_Object_init_type (y_Runtime * rt, void * type, void * super_type)
             sizeof (y_ObjectProtected),
             NULL,
             NULL,
-            y_Object_clear
+            y_Object_clear,
+            y_TYPE_SHARED
             );
 }
 
 y_ObjectClass *
 y_Object_type (y_Runtime *rt)
 {
-    if ( ! object_class ) {
-        object_class = (y_ObjectClass *)y_Runtime_init_type (
+    y_ObjectClass * type = y_Runtime_get_type (rt, &object_class);
+
+    if ( ! type ) {
+        type = (y_ObjectClass *)y_Runtime_init_type (
                 rt,                     /* Runtime */
                 object_type_name,       /* Name of type */
                 sizeof (y_ObjectClass), /* Size of class struct */
                 NULL,                   /* Superclass */
                 y_Object_init_type,     /* Type initialisation callback */
-                (void **)&object_class
+                &object_class           /* Slot of the type */
                 );
     }
-    return object_class;
+    return type;
 }
 
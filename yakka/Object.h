@@ -10,11 +10,32 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <assert.h>
+#include <apr.h>
 #include <apr_pools.h>
+#include <apr_time.h>
+
+/**
+ * Whether objects are locked.
+ *
+ * Yakka is built in three variants, each with its own pkg-config file.  The 
+ * checked variant (libyakka-0) locks objects in a threadsafe runtime and 
+ * checks every cast.  The unchecked variant (libyakka-0-unchecked) defines 
+ * y_UNCHECKED, which turns @ref y_SAFE_CAST_INSTANCE into a plain cast.  The 
+ * single-threaded variant (libyakka-0-single-threaded) defines 
+ * y_SINGLE_THREADED, which removes all locking at compile time: every runtime 
+ * behaves as if it were created without thread safety.
+ */
+#if APR_HAS_THREADS && ! defined (y_SINGLE_THREADED)
+#define y_HAS_THREADS  1
+#else
+#define y_HAS_THREADS  0
+#endif
 
 struct y_Error;
 struct y_Runtime;
 struct y_ObjectProtected;
+struct y_InterfaceDesc;
 
 /**
  * Structure for an object instance.
@@ -49,7 +70,8 @@ y_Object * y_Object_new (struct y_Runtime * rt, struct y_Error ** error);
 bool y_is_a (const void * self, const void * type);
 
 /**
- * Clear the contents of given object: unset or free all attributes.
+ * Clear the contents of given object: unset or free all attributes.  (A frozen 
+ * object is not cleared.)
  *
  * @param  self  The object to clear.
  */
@@ -59,7 +81,8 @@ void y_clear (void * self);
  * Create a copy of the given object.
  *
  * A new object of the same type as the provided instance will be instantiated, 
- * and all values will be copied to it.  It will then be returned.
+ * and all values will be copied to it.  It will then be returned.  (A frozen 
+ * object cannot change, so it is returned itself, with a new reference.)
  *
  * @param  self  The instance to which attributes should be copied.
  * @param  error  An error location, to be populated with any errors that may 
@@ -73,7 +96,8 @@ void * y_copy (const void * self, struct y_Error ** error);
  * Assign from one object to another of the same type.
  *
  * Assignment is only applicable where two instance objects are of the same 
- * type.
+ * type, and the "to" instance is not frozen.  In a threadsafe runtime, both 
+ * instances are locked during the assignment (see @ref y_lock_many).
  *
  * @param  to  The instance to which attributes should be copied.
  * @param  from  The instance from which attributes should be copied.
@@ -90,6 +114,8 @@ void y_destroy (void * self);
 
 /**
  * Lock an object.
+ *
+ * If the object is frozen (@ref y_freeze), this does nothing.
  */
 void y_lock (void * self);
 
@@ -97,15 +123,179 @@ void y_lock (void * self);
  * Attempt to gain a lock on an object.
  * 
  * @param  self  The object to attempt to lock.
- * @return   True on success, false if the object cannot be locked.
+ * @return   True on success, false if the object cannot be locked.  (A frozen 
+ * object needs no lock, so the attempt succeeds.)
  */
 bool y_try_lock (void * self);
 
+/**
+ * Lock several objects, without risk of deadlock.
+ *
+ * Whatever the order of the array, the objects are locked in a single, 
+ * canonical order (by address), so two threads locking overlapping sets of 
+ * objects cannot each hold a lock the other is waiting for.  NULL entries and 
+ * repeated entries are ignored.  Each time an object's lock has to be waited 
+ * for, the contention is counted by its runtime (see @ref 
+ * y_Runtime_get_lock_contention).
+ *
+ * Locks are re-entrant: an object may be locked again by the thread that holds 
+ * its lock, and must then be unlocked as many times.
+ *
+ * @param  objects  An array of objects.
+ * @param  count  The number of entries in the array.
+ */
+void y_lock_many (void * const * objects, size_t count);
+
+/**
+ * Attempt to lock several objects (see @ref y_lock_many), without waiting.
+ *
+ * If any of the objects is locked by another thread, the locks acquired so far 
+ * are released again (so that the caller can back off and retry).
+ *
+ * @param  objects  An array of objects.
+ * @param  count  The number of entries in the array.
+ * @return  True if all the objects were locked, false if none were.
+ */
+bool y_try_lock_many (void * const * objects, size_t count);
+
+/**
+ * Unlock several objects locked by @ref y_lock_many or @ref y_try_lock_many.
+ *
+ * @param  objects  The array of objects that was locked.
+ * @param  count  The number of entries in the array.
+ */
+void y_unlock_many (void * const * objects, size_t count);
+
+/**
+ * Lock an object in order to modify it.
+ *
+ * Setters use this rather than @ref y_lock, so that they fail if the object is 
+ * frozen.
+ *
+ * @param  self  The object to lock.
+ * @return  True if the object is locked (and must be unlocked with @ref 
+ * y_unlock), false if it is NULL or frozen.
+ */
+bool y_lock_for_write (void * self);
+
 /**
  * Unlock an object.
  */
 void y_unlock (void * self);
 
+/**
+ * Wait until an object is notified (@ref y_notify), using it as a monitor.
+ *
+ * The caller must hold the object's lock (@ref y_lock).  The lock is released 
+ * while waiting, and held again on return.  A wait may end without a 
+ * notification, so the caller should re-check the condition it is waiting for:
+ *
+ * @code
+ * y_lock (queue);
+ * while ( Queue_is_empty (queue) ) {
+ *     y_wait (queue, -1);
+ * }
+ * ...
+ * y_unlock (queue);
+ * @endcode
+ *
+ * Only objects with a mutex (instances of shared classes, in a threadsafe 
+ * runtime) can be waited on.  Any other object, or a frozen one (which cannot 
+ * change), is not waited for.
+ *
+ * @param  self  The object to wait on.
+ * @param  timeout  The longest time to wait (in microseconds), or a negative 
+ * value to wait indefinitely.
+ * @return  True if the wait ended (usually because of a notification); false 
+ * if it timed out, or the object cannot be waited on.
+ */
+bool y_wait (void * self, apr_interval_time_t timeout);
+
+/**
+ * Wake one thread waiting on an object (@ref y_wait), if any.
+ *
+ * The caller must hold the object's lock.
+ *
+ * @param  self  The object that was waited on.
+ */
+void y_notify (void * self);
+
+/**
+ * Wake all the threads waiting on an object (@ref y_wait).
+ *
+ * The caller must hold the object's lock.
+ *
+ * @param  self  The object that was waited on.
+ */
+void y_notify_all (void * self);
+
+/**
+ * Freeze an object: make it read-only from now on.
+ *
+ * A frozen object can be shared by any number of threads without locking: 
+ * locking it does nothing, its setters fail (see @ref y_lock_for_write), it 
+ * cannot be assigned to or cleared, and copying it returns the same instance 
+ * (with a new reference).  An object cannot be unfrozen.
+ *
+ * If another thread has the object locked, this waits for it to be unlocked.  
+ * The caller must not have it locked.
+ *
+ * @param  self  The object to freeze.
+ */
+void y_freeze (void * self);
+
+/**
+ * Check whether an object is frozen (@ref y_freeze).
+ *
+ * @param  self  An object.
+ * @return  True if the object is frozen.
+ */
+bool y_is_frozen (const void * self);
+
+/**
+ * Begin an optimistic (lock-free) read of an object.
+ *
+ * Locking an object (@ref y_lock) marks it as being written, and unlocking it 
+ * (@ref y_unlock) marks the write as complete.  A reader can use that 
+ * information to read members without taking the lock: it records the version 
+ * returned by this method, reads the members it needs, then checks with @ref 
+ * y_read_retry whether a write may have happened in the meantime.  If so, the 
+ * values read are inconsistent and the read must be repeated:
+ *
+ * @code
+ * do {
+ *     version = y_read_begin (self);
+ *     value = self->value;
+ * } while ( y_read_retry (self, version) );
+ * @endcode
+ *
+ * Readers never write to the object, so concurrent readers do not contend with 
+ * each other.  This suits small objects that are read often and written 
+ * rarely.  Members read in this way must not be dereferenced inside the read 
+ * section (a pointer may be freed by a concurrent writer), only copied.
+ *
+ * If the object is currently being written, this method waits until the write 
+ * is complete (so it must not be called by the thread holding the lock).
+ *
+ * Objects without a mutex (confined, immutable, or in a runtime without thread 
+ * safety) are only written by one thread, so their writes are not marked.
+ *
+ * @param  self  The object to be read.
+ * @return  The version of the object at the start of the read.
+ */
+unsigned int y_read_begin (const void * self);
+
+/**
+ * Check whether an optimistic read must be repeated.
+ *
+ * @param  self  The object that was read.
+ * @param  version  The version returned by @ref y_read_begin.
+ * @return  True if the object was written during the read (the values read 
+ * should be discarded and the read repeated), false if the read was 
+ * consistent.
+ */
+bool y_read_retry (const void * self, unsigned int version);
+
 /**
  * Acquire a reference to an object, increasing its reference count.
  */
@@ -116,6 +306,150 @@ void * y_ref (void * self);
  */
 void y_unref (void * self);
 
+/**
+ * Borrow the objects reached from an object for the duration of a statement 
+ * (usually a block), without acquiring references to them.
+ *
+ * Getters return borrowed references: the caller does not own them, so an 
+ * object returned may be released by another thread (or by the caller, via the 
+ * holder) while it is being used.  Within a borrow scope, no object of the 
+ * runtime that the thread can reach is destroyed; if it is released, its 
+ * destruction is deferred until the scope (and any other thread's scope that 
+ * could reach it) is closed.  This costs nothing per object borrowed:
+ *
+ * @code
+ * y_BORROW (delta) {
+ *     Gamma * c = Delta_get_c (delta);
+ *     ...  // c remains valid, even if it is unset from delta
+ * }
+ * @endcode
+ *
+ * The caller must hold a reference to the object (the holder) itself.  Borrow 
+ * scopes may be nested.  The statement must not be left by jumping out of it 
+ * (return, break or goto), because the scope would not be closed; use @ref 
+ * y_borrow_begin and @ref y_borrow_end directly where that is needed.
+ *
+ * A borrowed reference must not escape its scope: to keep it, acquire a 
+ * reference with y_ref inside the scope.  Unless assertions are disabled, 
+ * referencing an object that has been released (e.g. via a borrowed reference 
+ * that was kept) aborts.
+ *
+ * @param  self  An object, held by the caller (evaluated more than once).
+ */
+#define y_BORROW(self)                                          \
+    for ( int y_borrow_scope_ = (y_borrow_begin (self), 1);     \
+            y_borrow_scope_;                                    \
+            y_borrow_scope_ = (y_borrow_end (self), 0) )
+
+/**
+ * Open a borrow scope in the runtime of an object (see @ref y_BORROW).
+ *
+ * @param  self  An object, held by the caller.
+ */
+void y_borrow_begin (const void * self);
+
+/**
+ * Close a borrow scope opened by @ref y_borrow_begin.
+ *
+ * @param  self  The object passed to @ref y_borrow_begin.
+ */
+void y_borrow_end (const void * self);
+
+/**
+ * Hand over a reference, without changing the reference count.
+ *
+ * The reference held in a variable is returned, and the variable is set to 
+ * NULL, so that the caller can no longer use (or release) it.  This passes a 
+ * reference to code that keeps it without the pair of y_ref by the receiver 
+ * and y_unref by the giver.
+ *
+ * By convention, a setter whose name ends in "_steal" keeps the reference 
+ * passed to it (the caller's reference is handed over), whereas a plain setter 
+ * acquires a reference of its own:
+ *
+ * @code
+ * Gamma * gamma = Gamma_new (rt, error);
+ * Delta_set_c_steal (delta, y_move (&gamma));
+ * // gamma is now NULL
+ * @endcode
+ *
+ * Passing the variable itself rather than its address (y_move (gamma)) does 
+ * not compile.
+ *
+ * @param  location  The address of a variable that holds a reference to an 
+ * object.
+ * @return  The reference (NULL if the variable holds NULL).
+ */
+#define y_move(location)                                        \
+    y_move_ (( (void)sizeof (*(location) == NULL), (void **)(location) ))
+
+/**
+ * Implementation of @ref y_move, without its type check.
+ *
+ * @param  location  The address of a variable that holds a reference to an 
+ * object (or NULL).
+ * @return  The reference (NULL if location is NULL or holds NULL).
+ */
+void * y_move_ (void ** location);
+
+/**
+ * Make the reference count of an object "hot": split it into shards.
+ *
+ * An object that every thread references and releases, such as a shared 
+ * configuration, makes its reference count a point of contention between 
+ * processors.  The count of a hot object is instead split into shards, and 
+ * each thread references and releases the object through a shard of its own 
+ * (a reference that its shard does not hold is released from the shared count 
+ * or, rather than empty it, from other shards).  The shards are only folded 
+ * back into a single count when none of them holds a reference and the shared 
+ * count drops to zero, so that the object may be released for the last time, 
+ * or when it is made cold again (@ref y_make_shared_cold); it may then be made 
+ * hot again.
+ *
+ * Only shared and immutable objects in a threadsafe runtime can be made hot, 
+ * and only once their count is no longer biased towards the thread that 
+ * created them, or by that thread.  The caller must hold a reference.
+ *
+ * @param  self  An object.
+ * @return  True if the object is hot, false if it cannot be made hot.
+ */
+bool y_make_shared_hot (void * self);
+
+/**
+ * Make the reference count of an object "cold" again: fold its shards into a 
+ * single count (see @ref y_make_shared_hot).
+ *
+ * The caller must hold a reference.
+ *
+ * @param  self  An object.
+ */
+void y_make_shared_cold (void * self);
+
+/**
+ * Acquire a reference to each object in an array.
+ *
+ * This is equivalent to calling y_ref for each entry, but cheaper: the type of 
+ * each object is only checked if it differs from that of the previous object, 
+ * and consecutive entries that are the same object are counted in a single 
+ * update.  NULL entries are ignored.
+ *
+ * @param  objects  An array of objects.
+ * @param  count  The number of entries in the array.
+ */
+void y_ref_many (void * const * objects, size_t count);
+
+/**
+ * Release a reference to each object in an array.
+ *
+ * This is equivalent to calling y_unref for each entry, but cheaper (as for 
+ * @ref y_ref_many).  The objects that are no longer referenced are destroyed 
+ * together, once all the references have been released.
+ *
+ * @param  objects  An array of objects.
+ * @param  count  The number of entries in the array.
+ */
+void y_unref_many (void * const * objects, size_t count);
+
 /**
  * Acquire a weak reference to an object.
  */
@@ -157,6 +491,21 @@ void * y_get_implementation (const void * self, int interface_id);
  */
 void * y_get_implementation_by_name (const void * self, const char * name);
 
+/**
+ * Get the implementation that an instance's class provides for an interface, 
+ * by the interface's descriptor (see @ref y_DEFINE_INTERFACE).
+ *
+ * Unlike @ref y_get_implementation_by_name, this doesn't look up the name: the 
+ * descriptor holds the interface ID once it is registered.
+ *
+ * @param  self  An object instance.
+ * @param  desc  The descriptor of an interface.
+ * @return  A pointer to the instance's implementation of the specified 
+ * interface, or NULL if not implemented.
+ */
+void * y_get_implementation_of (const void * self,
+        struct y_InterfaceDesc * desc);
+
 /**
  * Safely cast an instance as a particular type.
  *
@@ -164,6 +513,9 @@ void * y_get_implementation_by_name (const void * self, const char * name);
  * and that it is of the specified type or a sub-type (@ref y_is_a).  If so, a 
  * cast to the target type is inserted in the code; if not, NULL is inserted.
  *
+ * In the unchecked variant (y_UNCHECKED) the cast is inserted unconditionally, 
+ * and the type is only checked by an assertion.
+ *
  * @param  self  An instance object.
  * @param  get_type  The method by which a class type can be retrieved.  (This 
  * will be used in checking that the object is of that type.)
@@ -171,9 +523,15 @@ void * y_get_implementation_by_name (const void * self, const char * name);
  * @return  An appropriately cast object, or "NULL" if the object is null or of 
  * an incompatible type.
  */
+#ifdef y_UNCHECKED
+#define y_SAFE_CAST_INSTANCE(self, get_type, cast_as)               \
+    ( assert (! (self) || y_is_a (self, get_type (y_get_runtime (self)))), \
+      (cast_as *)(self) )
+#else
 #define y_SAFE_CAST_INSTANCE(self, get_type, cast_as)               \
     ( (self && y_is_a (self, get_type (y_get_runtime (self)))) ?    \
       (cast_as *)self : NULL )
+#endif /* y_UNCHECKED */
 
 /**
  * Use @ref y_SAFE_CAST_INSTANCE to cast an instance as an Object.
@@ -1,27 +1,146 @@
 #include <assert.h>
+#include <limits.h>
+#include <apr_allocator.h>
+#include <apr_thread_cond.h>
 #include <apr_thread_mutex.h>
-#include <apr_hash.h>
+#include <apr_thread_proc.h>
+#include <apr_strings.h>
 #include "Runtime.h"
 #include "Object-protected.h"
+#include "WeakRef.h"
 #define APR_WANT_MEMFUNC
+#define APR_WANT_STRFUNC
 #include <apr_want.h>
 
+/* A registered name (of an interface or a type), with its hash and its 
+ * identifier (immutable once published) */
+typedef struct y_Name {
+    const char * name;
+    unsigned int hash;
+    int          id;
+} y_Name;
+
+/* Table of names: open addressing with linear probing, at most half full.  
+ * Entries are only ever added; when the table fills up, a larger copy 
+ * replaces it (the old one stays valid for readers still using it). */
+typedef struct y_NameTable {
+    unsigned int      mask;
+    y_Name * _Atomic  entries[];
+} y_NameTable;
+
+#define y_NAME_TABLE_MIN_SIZE  32
+
+/* The class structure of a runtime in a slot: NULL until initialised, and 
+ * claimed (under the runtime lock) by the thread that initialises it */
+typedef struct y_TypeEntry {
+    void * _Atomic type;
+    const char   * initialiser;  /* &y_current_thread, while initialising */
+} y_TypeEntry;
+
+/* Class structures of a runtime, indexed by slot (see y_TypeSlot).  Like the 
+ * interface table, it is replaced by a larger copy when a slot beyond its end 
+ * is needed. */
+typedef struct y_TypeTable {
+    int              size;
+    y_TypeEntry      entries[];
+} y_TypeTable;
+
+#define y_TYPE_TABLE_MIN_SIZE  16
+
+/* Identifiers of the interfaces registered by descriptor with a runtime, 
+ * indexed by the descriptor's slot (see y_InterfaceDesc::slot); 0 for those 
+ * not registered.  Replaced by a larger copy like the type table. */
+typedef struct y_InterfaceSlots {
+    int              size;
+    atomic_int       ids[];
+} y_InterfaceSlots;
+
+#define y_INTERFACE_SLOTS_MIN_SIZE  32
+
+/* A thread waiting (under the runtime lock) for the class in a slot to be 
+ * published; the runtime lists them to detect threads waiting on each other */
+typedef struct y_TypeWaiter {
+    const char          * thread;  /* &y_current_thread */
+    int                   index;
+    struct y_TypeWaiter * next;
+} y_TypeWaiter;
+
 typedef struct y_Runtime {
     apr_pool_t         * global_pool;
     bool                 cleanup_global; /* need to clean up */
     apr_pool_t         * objects_pool;
     bool                 cleanup_object; /* need to clean up */
     bool                 threadsafe;
+    atomic_bool          sealed;     /* no more registrations */
     apr_thread_mutex_t * mutex;
     /* Pool trash stack */
     apr_pool_t **        pool_buffer;
     int                  pool_buffer_size;
     int                  pool_buffer_pos;
+    /* Class structures, and their names */
+    y_TypeTable * _Atomic types;     /* readers: no lock */
+    apr_thread_cond_t  * type_published;  /* with the lock */
+    y_TypeWaiter       * type_waiters;    /* with the lock */
+    y_NameTable * _Atomic type_names; /* readers: no lock */
+    int                  type_name_count;
     /* Interface identifiers */
-    apr_hash_t         * interface_ids;
+    y_NameTable * _Atomic interface_ids; /* readers: no lock */
     int                  interface_size;
+    y_InterfaceSlots * _Atomic interface_slots; /* readers: no lock */
+    /* Per-thread reference counting state */
+    unsigned long        id;
+#if y_HAS_THREADS
+    apr_threadkey_t    * thread_refs_key;
+#endif /* y_HAS_THREADS */
+    y_ThreadRefs       * single_thread_refs; /* if not threadsafe */
+    y_ThreadRefs * _Atomic thread_refs;
+    /* Borrowing: deferred destruction of objects */
+    atomic_uint          borrowers;
+    atomic_ulong         epoch;
+    y_Object * _Atomic   retired;
+    /* Statistics */
+    atomic_ulong         lock_contention;
 } y_RuntimePrivate;
 
+/* Source of unique runtime identifiers */
+static atomic_ulong runtime_ids = 0;
+
+/* Source of type slots, shared by all runtimes (0 is never assigned) */
+static atomic_int type_slots = 0;
+
+/* Source of interface descriptor slots, likewise */
+static atomic_int interface_slots = 0;
+
+/* The class being initialised by the current thread, if any: its runtime, and 
+ * the pool that stands in for the runtime's global pool meanwhile (see 
+ * y_Runtime_get_global_pool) */
+typedef struct y_TypeInit {
+    y_Runtime  * rt;
+    apr_pool_t * pool;
+} y_TypeInit;
+
+static y_THREAD_LOCAL y_TypeInit current_type_init;
+
+y_THREAD_LOCAL char y_current_thread;
+
+/* The reference counting state of the current thread, for the runtime it was 
+ * last requested from.  (Cached to avoid a thread key lookup.) */
+static y_THREAD_LOCAL struct {
+    unsigned long  runtime_id;
+    y_ThreadRefs * refs;
+} current_thread_refs;
+
+apr_status_t y_Runtime_delete_thread_refs_key (void * data);
+void y_Runtime_thread_exit (void * data);
+y_ThreadRefs * y_Runtime_new_thread_refs (y_Runtime * rt);
+void y_Runtime_destroy_retired (y_Runtime * rt);
+
+static y_TypeTable * y_TypeTable_new (apr_pool_t * pool,
+        const y_TypeTable * old, int size);
+static y_NameTable * y_NameTable_new (apr_pool_t * pool, unsigned int size);
+static y_InterfaceSlots * y_InterfaceSlots_new (apr_pool_t * pool,
+        const y_InterfaceSlots * old, int size);
+
 /**
  * For internal use only (i.e. while the runtime is already locked): get the 
  * interface ID for the provided name.
@@ -55,7 +174,7 @@ y_Runtime_new (apr_pool_t * global_pool, apr_pool_t * objects_pool,
     rt->objects_pool = opool;
     rt->cleanup_object = ocleanup;
 
-    rt->threadsafe = threadsafe;
+    rt->threadsafe = ( y_HAS_THREADS && threadsafe );
 
     rt->pool_buffer_size = pool_buffer_size;
     if ( pool_buffer_size > 0 ) {
@@ -63,146 +182,956 @@ y_Runtime_new (apr_pool_t * global_pool, apr_pool_t * objects_pool,
                 pool_buffer_size * sizeof (apr_pool_t *));
         rt->pool_buffer_pos = 0;
     }
-#if APR_HAS_THREADS
+#if y_HAS_THREADS
     if ( rt->threadsafe ) {
         apr_thread_mutex_create (&(rt->mutex),
                 APR_THREAD_MUTEX_DEFAULT, gpool);
+        apr_thread_cond_create (&(rt->type_published), gpool);
     }
-#endif /* APR_HAS_THREADS */
+#endif /* y_HAS_THREADS */
 
-    rt->interface_ids = apr_hash_make (gpool);
+    atomic_init (&(rt->types), y_TypeTable_new (gpool, NULL,
+                y_TYPE_TABLE_MIN_SIZE));
+    atomic_init (&(rt->type_names),
+            y_NameTable_new (gpool, y_NAME_TABLE_MIN_SIZE));
+    rt->type_name_count = 0;
+    atomic_init (&(rt->interface_ids),
+            y_NameTable_new (gpool, y_NAME_TABLE_MIN_SIZE));
     rt->interface_size = 0;
+    atomic_init (&(rt->interface_slots), y_InterfaceSlots_new (gpool, NULL,
+                y_INTERFACE_SLOTS_MIN_SIZE));
+
+    rt->id = atomic_fetch_add (&runtime_ids, 1) + 1;
+    atomic_init (&(rt->thread_refs), NULL);
+    atomic_init (&(rt->borrowers), 0);
+    atomic_init (&(rt->epoch), 1);
+    atomic_init (&(rt->retired), NULL);
+    atomic_init (&(rt->lock_contention), 0);
+    atomic_init (&(rt->sealed), false);
+#if y_HAS_THREADS
+    if ( rt->threadsafe ) {
+        apr_threadkey_private_create (&(rt->thread_refs_key),
+                y_Runtime_thread_exit, gpool);
+        apr_pool_cleanup_register (gpool, rt->thread_refs_key,
+                y_Runtime_delete_thread_refs_key, apr_pool_cleanup_null);
+    }
+#endif /* y_HAS_THREADS */
+    if ( ! rt->threadsafe ) {
+        rt->single_thread_refs = y_Runtime_new_thread_refs (rt);
+    }
 
     return rt;
 }
 
+apr_status_t
+y_Runtime_delete_thread_refs_key (void * data)
+{
+#if y_HAS_THREADS
+    /* Threads that exit later must not touch the runtime */
+    apr_threadkey_private_delete ((apr_threadkey_t *)data);
+#endif /* y_HAS_THREADS */
+    return APR_SUCCESS;
+}
+
+void
+y_Runtime_thread_exit (void * data)
+{
+    y_ThreadRefs * refs = (y_ThreadRefs *)data;
+
+    /* Not to be reused while this thread still merges its queue */
+    atomic_fetch_add_explicit (&(refs->holders), 1, memory_order_relaxed);
+    /* Another thread may reuse this one's identity */
+    atomic_store (&(refs->thread), NULL);
+    atomic_store (&(refs->exited), true);
+    y_ThreadRefs_merge_queue (refs);
+    atomic_fetch_sub_explicit (&(refs->holders), 1, memory_order_release);
+}
+
+/**
+ * Create the reference counting state of the current thread: reuse that of an 
+ * exited thread which nothing refers to any more, or else add one to the 
+ * runtime's list.
+ */
+y_ThreadRefs *
+y_Runtime_new_thread_refs (y_Runtime * rt)
+{
+    y_ThreadRefs * refs = NULL;
+
+    y_Runtime_lock (rt);
+    for ( refs = atomic_load_explicit (&(rt->thread_refs),
+                memory_order_relaxed); refs; refs = refs->next ) {
+        if ( atomic_load (&(refs->exited)) &&
+                atomic_load_explicit (&(refs->holders),
+                    memory_order_acquire) == 0 ) {
+            break;
+        }
+    }
+    if ( refs ) {
+        refs->borrow_depth = 0;
+        atomic_store (&(refs->borrow_epoch), 0);
+        atomic_store (&(refs->thread), &y_current_thread);
+        atomic_store (&(refs->exited), false);
+    }
+    else {
+        refs = apr_pcalloc (rt->global_pool, sizeof (y_ThreadRefs));
+        atomic_init (&(refs->thread), &y_current_thread);
+        atomic_init (&(refs->queue), NULL);
+        atomic_init (&(refs->exited), false);
+        atomic_init (&(refs->borrow_epoch), 0);
+        atomic_init (&(refs->holders), 0);
+        refs->next = atomic_load_explicit (&(rt->thread_refs),
+                memory_order_relaxed);
+        atomic_store_explicit (&(rt->thread_refs), refs,
+                memory_order_release);
+    }
+    y_Runtime_unlock (rt);
+
+    return refs;
+}
+
+y_ThreadRefs *
+y_Runtime_get_thread_refs (y_Runtime * rt)
+{
+    y_ThreadRefs * refs = rt->single_thread_refs;
+
+    if ( current_thread_refs.runtime_id == rt->id ) {
+        return current_thread_refs.refs;
+    }
+#if y_HAS_THREADS
+    if ( rt->thread_refs_key ) {
+        void * data = NULL;
+
+        apr_threadkey_private_get (&data, rt->thread_refs_key);
+        refs = (y_ThreadRefs *)data;
+        if ( ! refs ) {
+            refs = y_Runtime_new_thread_refs (rt);
+            apr_threadkey_private_set (refs, rt->thread_refs_key);
+        }
+    }
+#endif /* y_HAS_THREADS */
+    current_thread_refs.runtime_id = rt->id;
+    current_thread_refs.refs = refs;
+
+    return refs;
+}
+
+void
+y_Runtime_merge_refcounts (y_Runtime * rt)
+{
+    y_ThreadRefs * refs = y_Runtime_get_thread_refs (rt);
+
+    if ( refs ) {
+        y_ThreadRefs_merge_queue (refs);
+    }
+    if ( atomic_load (&(rt->retired)) ) {
+        y_Runtime_destroy_retired (rt);
+    }
+}
+
+void
+y_Runtime_borrow_begin (y_Runtime * rt)
+{
+    y_ThreadRefs * refs = y_Runtime_get_thread_refs (rt);
+
+    if ( refs->borrow_depth++ == 0 ) {
+        atomic_fetch_add (&(rt->borrowers), 1);
+        atomic_store (&(refs->borrow_epoch), atomic_load (&(rt->epoch)));
+        /* Objects must not be read before the scope is visibly open */
+        atomic_thread_fence (memory_order_seq_cst);
+    }
+}
+
+void
+y_Runtime_borrow_end (y_Runtime * rt)
+{
+    y_ThreadRefs * refs = y_Runtime_get_thread_refs (rt);
+
+    assert (refs->borrow_depth > 0);
+    if ( --(refs->borrow_depth) == 0 ) {
+        atomic_store (&(refs->borrow_epoch), 0);
+        atomic_fetch_sub (&(rt->borrowers), 1);
+        if ( atomic_load (&(rt->retired)) ) {
+            y_Runtime_destroy_retired (rt);
+        }
+    }
+}
+
+bool
+y_Runtime_defer_destroy (y_Runtime * rt, void * self)
+{
+    y_Object * obj = (y_Object *)self;
+    y_Object * next = NULL;
+
+    /* The object was made unreachable before its last reference was released; 
+     * a scope opened after this point cannot reach it. */
+    atomic_thread_fence (memory_order_seq_cst);
+    if ( atomic_load (&(rt->borrowers)) == 0 ) {
+        return false;
+    }
+    obj->protect->retired_epoch = atomic_fetch_add (&(rt->epoch), 1);
+    next = atomic_load_explicit (&(rt->retired), memory_order_relaxed);
+    do {
+        obj->protect->next_queued = next;
+    } while ( ! atomic_compare_exchange_weak_explicit (&(rt->retired), &next,
+                obj, memory_order_release, memory_order_relaxed) );
+
+    /* The last scope may have closed before the object was added */
+    if ( atomic_load (&(rt->borrowers)) == 0 ) {
+        y_Runtime_destroy_retired (rt);
+    }
+    return true;
+}
+
+/**
+ * Destroy the objects whose destruction was deferred, and that can no longer 
+ * be reached from any open borrow scope.
+ */
+void
+y_Runtime_destroy_retired (y_Runtime * rt)
+{
+    y_Object * obj = atomic_exchange_explicit (&(rt->retired), NULL,
+            memory_order_acquire);
+    unsigned long oldest = ULONG_MAX;
+    bool kept = false;
+    y_ThreadRefs * refs;
+
+    atomic_thread_fence (memory_order_seq_cst);
+    for ( refs = atomic_load_explicit (&(rt->thread_refs),
+                memory_order_acquire); refs; refs = refs->next ) {
+        unsigned long epoch = atomic_load (&(refs->borrow_epoch));
+        if ( epoch && epoch < oldest ) {
+            oldest = epoch;
+        }
+    }
+
+    while ( obj ) {
+        y_Object * next = obj->protect->next_queued;
+
+        if ( obj->protect->retired_epoch < oldest ) {
+            y_destroy (obj);
+        }
+        else {
+            /* Still reachable from a scope opened before it was released */
+            y_Object * head = atomic_load_explicit (&(rt->retired),
+                    memory_order_relaxed);
+            do {
+                obj->protect->next_queued = head;
+            } while ( ! atomic_compare_exchange_weak_explicit (&(rt->retired),
+                        &head, obj, memory_order_release,
+                        memory_order_relaxed) );
+            kept = true;
+        }
+        obj = next;
+    }
+    /* The scopes that required them may have closed in the meantime */
+    if ( kept && atomic_load (&(rt->borrowers)) == 0 ) {
+        y_Runtime_destroy_retired (rt);
+    }
+}
+
+void
+y_Runtime_count_lock_contention (y_Runtime * rt)
+{
+    atomic_fetch_add_explicit (&(rt->lock_contention), 1,
+            memory_order_relaxed);
+}
+
+unsigned long
+y_Runtime_get_lock_contention (y_Runtime * rt)
+{
+    return atomic_load_explicit (&(rt->lock_contention),
+            memory_order_relaxed);
+}
+
 void
 y_Runtime_lock (y_Runtime * rt)
 {
-#if APR_HAS_THREADS
+#if y_HAS_THREADS
     if ( rt->mutex ) {
         apr_thread_mutex_lock (rt->mutex);
     }
-#endif /* APR_HAS_THREADS */
+#endif /* y_HAS_THREADS */
 }
 
 void
 y_Runtime_unlock (y_Runtime * rt)
 {
-#if APR_HAS_THREADS
+#if y_HAS_THREADS
     if ( rt->mutex ) {
         apr_thread_mutex_unlock (rt->mutex);
     }
-#endif /* APR_HAS_THREADS */
+#endif /* y_HAS_THREADS */
 }
 
-apr_status_t
-y_erase_type (void * data)
+/**
+ * Clear an inline cache, once the classes in it are gone.
+ */
+static apr_status_t
+y_InlineCache_reset (void * data)
 {
-    void ** type_location = (void **)data;
-    if ( type_location ) {
-        *type_location = NULL;
+    y_InlineCache * cache = (y_InlineCache *)data;
+    int i;
+
+    for ( i = 0; i < y_INLINE_CACHE_SIZE; i++ ) {
+        atomic_store_explicit (&(cache->types[i]), NULL, memory_order_relaxed);
+        cache->vtables[i] = NULL;
     }
+    atomic_store_explicit (&(cache->rt), NULL, memory_order_release);
     return APR_SUCCESS;
 }
 
+bool
+y_Runtime_add_inline_cache (y_Runtime * rt, y_InlineCache * cache)
+{
+    y_Runtime * cache_rt = atomic_load_explicit (&(cache->rt),
+            memory_order_acquire);
+
+    if ( ! cache_rt ) {
+        y_Runtime_lock (rt);
+        cache_rt = atomic_load (&(cache->rt));
+        if ( ! cache_rt ) {
+            apr_pool_cleanup_register (rt->global_pool, cache,
+                    y_InlineCache_reset, apr_pool_cleanup_null);
+            atomic_store (&(cache->rt), rt);
+            cache_rt = rt;
+        }
+        y_Runtime_unlock (rt);
+    }
+    return ( cache_rt == rt );
+}
+
+static y_NameTable *
+y_NameTable_new (apr_pool_t * pool, unsigned int size)
+{
+    y_NameTable * table = apr_pcalloc (pool, sizeof (y_NameTable) +
+            size * sizeof (y_Name * _Atomic));
+
+    table->mask = size - 1;
+    return table;
+}
+
+/**
+ * Hash a name (FNV-1a).
+ */
+static unsigned int
+y_name_hash (const char * name)
+{
+    unsigned int hash = 2166136261u;
+
+    while ( *name ) {
+        hash = (hash ^ (unsigned char)*name++) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Find the slot of a name in a table: either the entry with that name, or the 
+ * empty slot where it would be added.  Wait-free: the table always has empty 
+ * slots.
+ */
+static unsigned int
+y_NameTable_find (y_NameTable * table, const char * name, unsigned int hash,
+        y_Name ** found)
+{
+    unsigned int i = hash & table->mask;
+    y_Name * entry;
+
+    while ( (entry = atomic_load_explicit (&(table->entries[i]),
+                    memory_order_acquire)) ) {
+        if ( entry->hash == hash && strcmp (entry->name, name) == 0 ) {
+            break;
+        }
+        i = (i + 1) & table->mask;
+    }
+    *found = entry;
+    return i;
+}
+
+/**
+ * Look up the identifier of a name, without locking.
+ *
+ * @return  The identifier, or 0 if the name is not in the table.
+ */
+static int
+y_NameTable_get_id (y_NameTable * _Atomic * table_location,
+        const char * name)
+{
+    y_Name * entry = NULL;
+
+    y_NameTable_find (atomic_load_explicit (table_location,
+                memory_order_acquire), name, y_name_hash (name), &entry);
+    return ( entry ? entry->id : 0 );
+}
+
+/**
+ * Add a name that is not in a table yet (a copy of it is kept), publishing a 
+ * larger copy of the table first if it is full.  The runtime must be locked.
+ *
+ * @param  count  The number of names in the table.
+ */
+static void
+y_NameTable_add (apr_pool_t * pool, y_NameTable * _Atomic * table_location,
+        int count, const char * name, int id)
+{
+    y_NameTable * table = atomic_load_explicit (table_location,
+            memory_order_relaxed);
+    y_Name * entry = NULL;
+    unsigned int hash = y_name_hash (name);
+    unsigned int i;
+
+    if ( 2 * (count + 1) > table->mask + 1 ) {
+        /* Publish a larger copy, then add the name to it */
+        y_NameTable * bigger = y_NameTable_new (pool, 2 * (table->mask + 1));
+        unsigned int j;
+
+        for ( j = 0; j <= table->mask; j++ ) {
+            y_Name * old = atomic_load_explicit (&(table->entries[j]),
+                    memory_order_relaxed);
+            if ( old ) {
+                y_Name * unused;
+                atomic_store_explicit (&(bigger->entries[
+                            y_NameTable_find (bigger, old->name, old->hash,
+                                &unused)]), old, memory_order_relaxed);
+            }
+        }
+        atomic_store_explicit (table_location, bigger, memory_order_release);
+        table = bigger;
+    }
+    i = y_NameTable_find (table, name, hash, &entry);
+    assert (! entry);
+    entry = apr_palloc (pool, sizeof (y_Name));
+    entry->name = apr_pstrdup (pool, name);
+    entry->hash = hash;
+    entry->id = id;
+    atomic_store_explicit (&(table->entries[i]), entry, memory_order_release);
+}
+
+/**
+ * Look up the identifier of an interface, without locking.
+ *
+ * @return  The identifier, or 0 if the name is not registered.
+ */
+static int
+y_Runtime_find_interface_id (y_Runtime * rt, const char * name)
+{
+    return y_NameTable_get_id (&(rt->interface_ids), name);
+}
+
 int
 y_Runtime_get_interface_id_nolock (y_Runtime * rt, const char * name)
 {
-    int * id = NULL;
+    int id = y_Runtime_find_interface_id (rt, name);
 
-    id = (int *)apr_hash_get (rt->interface_ids, name, APR_HASH_KEY_STRING);
-    if ( ! id ) {
-        id = apr_pcalloc (rt->global_pool, sizeof (int));
-        *id = ++(rt->interface_size);
-        apr_hash_set (rt->interface_ids, name, APR_HASH_KEY_STRING, id);
+    if ( id || atomic_load_explicit (&(rt->sealed), memory_order_relaxed) ) {
+        return id;
     }
-    return (id ? *id : 0);
+    id = rt->interface_size + 1;
+    y_NameTable_add (rt->global_pool, &(rt->interface_ids),
+            rt->interface_size, name, id);
+    rt->interface_size = id;
+    return id;
 }
 
 int
 y_Runtime_get_interface_id (y_Runtime * rt, const char * name)
 {
-    int * id_ptr = NULL;
-    int id = 0;
+    int id = y_Runtime_find_interface_id (rt, name);
 
-    id_ptr = (int *)apr_hash_get (rt->interface_ids, name, APR_HASH_KEY_STRING);
-    if ( ! id_ptr ) {
+    if ( ! id && ! y_Runtime_is_sealed (rt) ) {
         y_Runtime_lock (rt);
         id = y_Runtime_get_interface_id_nolock (rt, name);
         y_Runtime_unlock (rt);
     }
-    else {
-        id = *id_ptr;
+    return id;
+}
+
+static y_InterfaceSlots *
+y_InterfaceSlots_new (apr_pool_t * pool, const y_InterfaceSlots * old,
+        int size)
+{
+    y_InterfaceSlots * table = apr_pcalloc (pool,
+            sizeof (y_InterfaceSlots) + size * sizeof (atomic_int));
+    int i;
+
+    table->size = size;
+    for ( i = 0; old && i < old->size; i++ ) {
+        atomic_init (&(table->ids[i]), atomic_load_explicit (
+                    &(old->ids[i]), memory_order_relaxed));
+    }
+    return table;
+}
+
+/**
+ * Get the slot of an interface descriptor, assigning one if it has none yet.
+ */
+static int
+y_InterfaceDesc_get_slot (y_InterfaceDesc * desc)
+{
+    int slot = atomic_load_explicit (&(desc->slot), memory_order_acquire);
+
+    if ( ! slot ) {
+        int fresh = atomic_fetch_add (&interface_slots, 1) + 1;
+        /* If another thread got there first, use its slot (this one is lost) */
+        if ( atomic_compare_exchange_strong (&(desc->slot), &slot, fresh) ) {
+            slot = fresh;
+        }
+    }
+    return slot;
+}
+
+/**
+ * Get the table of interface descriptors, growing it to hold the given slot 
+ * if required.  The runtime must be locked.
+ */
+static y_InterfaceSlots *
+y_Runtime_get_interface_slots (y_Runtime * rt, int slot)
+{
+    y_InterfaceSlots * table = atomic_load_explicit (&(rt->interface_slots),
+            memory_order_relaxed);
+
+    if ( slot >= table->size ) {
+        /* Publish a larger copy */
+        int size = 2 * table->size;
+        while ( slot >= size ) {
+            size *= 2;
+        }
+        table = y_InterfaceSlots_new (rt->global_pool, table, size);
+        atomic_store_explicit (&(rt->interface_slots), table,
+                memory_order_release);
+    }
+    return table;
+}
+
+int
+y_Runtime_find_interface (y_Runtime * rt, const y_InterfaceDesc * desc)
+{
+    int slot = atomic_load_explicit (&(desc->slot), memory_order_acquire);
+    y_InterfaceSlots * table = atomic_load_explicit (&(rt->interface_slots),
+            memory_order_acquire);
+
+    if ( ! slot || slot >= table->size ) {
+        return 0;
+    }
+    return atomic_load_explicit (&(table->ids[slot]), memory_order_relaxed);
+}
+
+int
+y_Runtime_register_interface (y_Runtime * rt, y_InterfaceDesc * desc)
+{
+    int id = y_Runtime_find_interface (rt, desc);
+    int slot;
+    y_InterfaceSlots * table;
+
+    if ( id ) {
+        return id;
+    }
+    id = y_Runtime_get_interface_id (rt, desc->name);
+    if ( ! id ) {
+        return 0;
+    }
+    slot = y_InterfaceDesc_get_slot (desc);
+    table = atomic_load_explicit (&(rt->interface_slots),
+            memory_order_acquire);
+    if ( slot >= table->size && ! y_Runtime_is_sealed (rt) ) {
+        y_Runtime_lock (rt);
+        table = y_Runtime_get_interface_slots (rt, slot);
+        y_Runtime_unlock (rt);
+    }
+    if ( slot < table->size ) {
+        /* Every thread stores the same identifier, so no lock is needed (one 
+         * stored in a table being replaced is merely stored again later) */
+        atomic_store_explicit (&(table->ids[slot]), id, memory_order_relaxed);
     }
     return id;
 }
 
+void
+y_Runtime_register_interfaces (y_Runtime * rt,
+        y_InterfaceDesc * const * start, y_InterfaceDesc * const * end)
+{
+    y_InterfaceDesc * const * desc;
+
+    for ( desc = start; desc && desc < end; desc++ ) {
+        if ( *desc ) {
+            y_Runtime_register_interface (rt, *desc);
+        }
+    }
+}
+
+/**
+ * Add an implementation to a packed set of interfaces, replacing any existing 
+ * implementation of the same interface.  The table must have room for it.
+ */
+static void
+y_Interfaces_insert (y_Interfaces * interfaces, int id, void * vtable)
+{
+    int slot = id & interfaces->mask;
+
+    assert (id);  /* 0 marks an unused entry */
+    while ( interfaces->entries[slot].id &&
+            interfaces->entries[slot].id != id ) {
+        slot = (slot + 1) & interfaces->mask;
+    }
+    if ( ! interfaces->entries[slot].id ) {
+        interfaces->entries[slot].id = id;
+        interfaces->size++;
+    }
+    interfaces->entries[slot].vtable = vtable;
+    interfaces->implements |= (uint64_t)1 << (id % y_INTERFACE_BITS);
+}
+
 y_Interfaces *
 y_Runtime_pack_interfaces (y_Runtime * rt, y_InterfaceSpec * specs)
 {
-    int i = 0;
-    int max_id = 0;
+    return y_Runtime_merge_interfaces (rt, NULL, specs);
+}
+
+y_Interfaces *
+y_Runtime_merge_interfaces (y_Runtime * rt, const y_Interfaces * inherited,
+        y_InterfaceSpec * specs)
+{
+    int count = ( inherited ? inherited->size : 0 );
+    int capacity = 2;
+    int i;
     y_Interfaces * interfaces = NULL;
 
-    while ( specs[i].name ) {
-        int spec_id;
-        y_InterfaceSpec spec = specs[i];
-        spec_id = y_Runtime_get_interface_id_nolock (rt, spec.name);
-        if ( spec_id > max_id ) {
-            max_id = spec_id;
+    for ( i = 0; specs && specs[i].name; i++ ) {
+        count++;
+    }
+    if ( count > 0 ) {
+        /* At most half full */
+        while ( capacity < 2 * count ) {
+            capacity *= 2;
         }
-        i++;
-    }
-    if ( max_id > 0 ) {
-        interfaces = apr_pcalloc (rt->global_pool, sizeof (y_Interfaces));
-        interfaces->size = max_id + 1;
-        interfaces->vtables = apr_pcalloc (rt->global_pool,
-                (interfaces->size) * sizeof (void *));
-        i = 0;
-        while ( specs[i].name ) {
-            y_InterfaceSpec spec = specs[i];
-            interfaces->
-                vtables[y_Runtime_get_interface_id_nolock (rt, spec.name)] =
-                spec.vtable;
-            i++;
+        apr_pool_t * pool = y_Runtime_get_global_pool (rt);
+        interfaces = apr_pcalloc (pool, sizeof (y_Interfaces));
+        interfaces->mask = capacity - 1;
+        interfaces->entries = apr_pcalloc (pool,
+                capacity * sizeof (y_InterfaceEntry));
+        for ( i = 0; inherited && i <= inherited->mask; i++ ) {
+            if ( inherited->entries[i].id ) {
+                y_Interfaces_insert (interfaces, inherited->entries[i].id,
+                        inherited->entries[i].vtable);
+            }
+        }
+        for ( i = 0; specs && specs[i].name; i++ ) {
+            int id = y_Runtime_get_interface_id (rt, specs[i].name);
+
+            /* Not registered before the runtime was sealed: nothing can ask 
+             * for it */
+            if ( id ) {
+                y_Interfaces_insert (interfaces, id, specs[i].vtable);
+            }
         }
     }
     return interfaces;
 }
 
+/**
+ * Allocate a type table, copying the class structures of an old one.
+ */
+static y_TypeTable *
+y_TypeTable_new (apr_pool_t * pool, const y_TypeTable * old, int size)
+{
+    y_TypeTable * table = apr_pcalloc (pool,
+            sizeof (y_TypeTable) + size * sizeof (y_TypeEntry));
+    int i;
+
+    table->size = size;
+    for ( i = 0; old && i < old->size; i++ ) {
+        atomic_init (&(table->entries[i].type), atomic_load_explicit (
+                    &(old->entries[i].type), memory_order_relaxed));
+        table->entries[i].initialiser = old->entries[i].initialiser;
+    }
+    return table;
+}
+
+/**
+ * Get the slot index of a type, assigning one if it has none yet.
+ */
+static int
+y_TypeSlot_get_index (y_TypeSlot * type_slot)
+{
+    int index = atomic_load_explicit (type_slot, memory_order_acquire);
+
+    if ( ! index ) {
+        int fresh = atomic_fetch_add (&type_slots, 1) + 1;
+        /* If another thread got there first, use its slot (this one is lost) */
+        if ( atomic_compare_exchange_strong (type_slot, &index, fresh) ) {
+            index = fresh;
+        }
+    }
+    return index;
+}
+
 void *
-y_Runtime_init_type (y_Runtime * rt, const char * type_name,
+y_Runtime_get_type (y_Runtime * rt, y_TypeSlot * type_slot)
+{
+    return y_Runtime_get_type_by_id (rt,
+            atomic_load_explicit (type_slot, memory_order_acquire));
+}
+
+/**
+ * Get the entry of a slot in the type table, growing the table if required.  
+ * The runtime must be locked.
+ */
+static y_TypeEntry *
+y_Runtime_get_type_entry (y_Runtime * rt, int index)
+{
+    y_TypeTable * table = atomic_load_explicit (&(rt->types),
+            memory_order_relaxed);
+
+    if ( index >= table->size ) {
+        /* Publish a larger copy */
+        int size = 2 * table->size;
+        while ( index >= size ) {
+            size *= 2;
+        }
+        table = y_TypeTable_new (rt->global_pool, table, size);
+        atomic_store_explicit (&(rt->types), table, memory_order_release);
+    }
+    return &(table->entries[index]);
+}
+
+/**
+ * Get the pool for the class structures that a thread initialises: in a 
+ * threadsafe runtime, a subpool of the global pool with an allocator of its 
+ * own, so that it may be used without the runtime lock.  As an allocator and 
+ * its pool cost at least 8 KB, a thread has one for all the classes it 
+ * initialises (and leaves it to the next thread that reuses its state).  The 
+ * runtime must be locked.
+ *
+ * @param  refs  The state of the current thread.
+ * @return  The pool, or NULL if it could not be created.
+ */
+static apr_pool_t *
+y_Runtime_get_type_pool (y_Runtime * rt, y_ThreadRefs * refs)
+{
+    apr_allocator_t * allocator = NULL;
+    apr_pool_t * pool = NULL;
+
+    if ( ! rt->threadsafe ) {
+        return rt->global_pool;  /* No lock to hold on to */
+    }
+    if ( refs->type_pool ) {
+        return refs->type_pool;
+    }
+    if ( apr_allocator_create (&allocator) != APR_SUCCESS ) {
+        return NULL;
+    }
+    if ( apr_pool_create_ex (&pool, rt->global_pool, NULL, allocator) !=
+            APR_SUCCESS ) {
+        apr_allocator_destroy (allocator);
+        return NULL;
+    }
+    apr_allocator_owner_set (allocator, pool);
+    refs->type_pool = pool;
+    return pool;
+}
+
+/**
+ * Wait for the class structure of a slot to be published by the thread that 
+ * initialises it.  The runtime must be locked.
+ *
+ * @return  The class structure, or NULL if it can't be waited for: the 
+ * initialising thread is itself waiting (directly or through other threads) 
+ * for a class that the current thread is initialising.
+ */
+static void *
+y_Runtime_await_type (y_Runtime * rt, int index)
+{
+    y_TypeEntry * entry = y_Runtime_get_type_entry (rt, index);
+    const char * thread = entry->initialiser;
+    void * type = NULL;
+
+    /* Follow the threads waiting on each other */
+    while ( thread ) {
+        y_TypeWaiter * other = rt->type_waiters;
+
+        if ( thread == &y_current_thread ) {
+            return NULL;
+        }
+        while ( other && other->thread != thread ) {
+            other = other->next;
+        }
+        thread = ( other ?
+                y_Runtime_get_type_entry (rt, other->index)->initialiser :
+                NULL );
+    }
+#if y_HAS_THREADS
+    y_TypeWaiter waiter = { &y_current_thread, index, rt->type_waiters };
+    y_TypeWaiter ** link = NULL;
+
+    rt->type_waiters = &waiter;
+    for ( ;; ) {
+        /* The table may have grown meanwhile */
+        entry = y_Runtime_get_type_entry (rt, index);
+        type = atomic_load_explicit (&(entry->type), memory_order_relaxed);
+        if ( type || ! entry->initialiser ) {
+            break;
+        }
+        apr_thread_cond_wait (rt->type_published, rt->mutex);
+    }
+    for ( link = &(rt->type_waiters); *link != &waiter;
+            link = &((*link)->next) ) {
+    }
+    *link = waiter.next;
+#endif /* y_HAS_THREADS */
+    return type;
+}
+
+/**
+ * Allocate and initialise a class structure, unless it already exists.
+ *
+ * Each slot is initialised once: the first thread to get there claims it, and 
+ * runs the initialisation without the runtime lock (using a pool of its own, 
+ * or failing if it can't have one), 
+ * so that unrelated classes may be initialised in parallel, while other 
+ * threads wanting the same class wait for it to be published (unless that 
+ * would deadlock, in which case they get NULL).
+ *
+ * @param  type_name  The name under which the type may be found (unless 
+ * another type has it already).
+ * @param  init_type  Initialises the class structure (a type-specific 
+ * initialisation method, or @ref y_init_class).
+ * @param  desc  The class descriptor, if init_type is y_init_class.
+ */
+static void *
+y_Runtime_create_type (y_Runtime * rt, const char * type_name,
         int type_size, void * super_type,
         void (* init_type) (y_Runtime * rt, void * type, void * super_type),
-        void ** type_location)
+        const y_ClassDesc * desc, y_TypeSlot * type_slot)
 {
-    y_ObjectClass * type = NULL;
+    int index = y_TypeSlot_get_index (type_slot);
+    y_ObjectClass * type = y_Runtime_get_type (rt, type_slot);
+    y_TypeEntry * entry;
+    y_ThreadRefs * refs;
+    apr_pool_t * pool;
+    y_TypeInit outer_type_init = current_type_init;
 
+    if ( type || y_Runtime_is_sealed (rt) ) {
+        return type;
+    }
+    if ( super_type && (((y_ObjectClass *)super_type)->flags & y_TYPE_FINAL) ) {
+        return NULL;  /* Final classes can't be subclassed */
+    }
+    refs = y_Runtime_get_thread_refs (rt);
     y_Runtime_lock (rt);
-    if ( ! *type_location ) {
-        /* Allocate memory for the type and copy the supertype over it */
-        type = apr_pcalloc (rt->global_pool, type_size);
-        if ( super_type ) {
-            int super_size = ((y_ObjectClass *)super_type)->class_size;
-            assert (! (super_size > type_size));
-            memcpy (type, super_type, super_size);
+    entry = y_Runtime_get_type_entry (rt, index);
+    type = atomic_load_explicit (&(entry->type), memory_order_relaxed);
+    if ( type || entry->initialiser ) {
+        /* Being initialised by another thread (a class can't need itself) */
+        assert (type || entry->initialiser != &y_current_thread);
+        if ( ! type ) {
+            type = y_Runtime_await_type (rt, index);
         }
-        /* Perform type-specific initialisation */
+        y_Runtime_unlock (rt);
+        return type;
+    }
+    /* Sealed (under the lock) since last checked: too late to claim it */
+    if ( atomic_load_explicit (&(rt->sealed), memory_order_relaxed) ) {
+        y_Runtime_unlock (rt);
+        return NULL;
+    }
+    pool = y_Runtime_get_type_pool (rt, refs);
+    if ( ! pool ) {
+        y_Runtime_unlock (rt);
+        return NULL;
+    }
+    entry->initialiser = &y_current_thread;
+    y_Runtime_unlock (rt);
+
+    current_type_init.rt = rt;
+    current_type_init.pool = pool;
+
+    /* Allocate memory for the type and copy the supertype over it */
+    type = apr_pcalloc (current_type_init.pool, type_size);
+    if ( super_type ) {
+        int super_size = ((y_ObjectClass *)super_type)->class_size;
+        assert (! (super_size > type_size));
+        memcpy (type, super_type, super_size);
+    }
+    /* Perform type-specific initialisation */
+    if ( desc ) {
+        y_init_class (rt, type, super_type, desc);
+    }
+    else {
         init_type (rt, type, super_type);
-        /* Keep this type */
-        apr_pool_cleanup_register (rt->global_pool, type_location,
-                y_erase_type, apr_pool_cleanup_null);
-        *type_location = type;
+    }
+    current_type_init = outer_type_init;
+
+    /* Keep this type (the table may have grown meanwhile) */
+    y_Runtime_lock (rt);
+    entry = y_Runtime_get_type_entry (rt, index);
+    atomic_store_explicit (&(entry->type), type, memory_order_release);
+    entry->initialiser = NULL;
+    if ( rt->type_waiters ) {
+        apr_thread_cond_broadcast (rt->type_published);
+    }
+    if ( type_name && ! y_NameTable_get_id (&(rt->type_names), type_name) ) {
+        y_NameTable_add (rt->global_pool, &(rt->type_names),
+                rt->type_name_count++, type_name, index);
     }
     y_Runtime_unlock (rt);
 
     return type;
 }
 
+void *
+y_Runtime_init_type (y_Runtime * rt, const char * type_name,
+        int type_size, void * super_type,
+        void (* init_type) (y_Runtime * rt, void * type, void * super_type),
+        y_TypeSlot * type_slot)
+{
+    return y_Runtime_create_type (rt, type_name, type_size, super_type,
+            init_type, NULL, type_slot);
+}
+
+void *
+y_Runtime_init_class (y_Runtime * rt, const y_ClassDesc * desc)
+{
+    /* The super class first: it may need the lock too */
+    void * super_type = desc->get_super (rt);
+
+    return y_Runtime_create_type (rt, desc->name, desc->class_size,
+            super_type, NULL, desc, desc->type_slot);
+}
+
+int
+y_Runtime_find_type_id (y_Runtime * rt, const char * type_name)
+{
+    if ( ! type_name ) {
+        return 0;
+    }
+    return y_NameTable_get_id (&(rt->type_names), type_name);
+}
+
+void *
+y_Runtime_get_type_by_id (y_Runtime * rt, int type_id)
+{
+    y_TypeTable * table = atomic_load_explicit (&(rt->types),
+            memory_order_acquire);
+
+    if ( type_id <= 0 || type_id >= table->size ) {
+        return NULL;
+    }
+    return atomic_load_explicit (&(table->entries[type_id].type),
+            memory_order_acquire);
+}
+
+void *
+y_Runtime_find_type (y_Runtime * rt, const char * type_name)
+{
+    return y_Runtime_get_type_by_id (rt,
+            y_Runtime_find_type_id (rt, type_name));
+}
+
 apr_pool_t *
 y_Runtime_get_global_pool (y_Runtime * rt)
 {
+    if ( current_type_init.rt == rt ) {
+        return current_type_init.pool;
+    }
     return rt->global_pool;
 }
 
@@ -212,6 +1141,28 @@ y_Runtime_is_threadsafe (y_Runtime * rt)
     return rt->threadsafe;
 }
 
+void
+y_Runtime_seal (y_Runtime * rt)
+{
+    /* Needed to report errors, e.g. about unregistered classes */
+    y_Object_type (rt);
+    y_Error_type (rt);
+    y_WeakRef_type (rt);
+
+    y_Runtime_lock (rt);
+    /* Make room for the descriptors registered so far, by any runtime: the 
+     * table is not grown once sealed */
+    y_Runtime_get_interface_slots (rt, atomic_load (&interface_slots));
+    atomic_store_explicit (&(rt->sealed), true, memory_order_release);
+    y_Runtime_unlock (rt);
+}
+
+bool
+y_Runtime_is_sealed (y_Runtime * rt)
+{
+    return atomic_load_explicit (&(rt->sealed), memory_order_acquire);
+}
+
 apr_pool_t *
 y_Runtime_create_object_pool (y_Runtime * rt, y_Error ** error)
 {
@@ -18,6 +18,16 @@
 typedef struct y_Runtime y_Runtime;
 struct y_ObjectClass;
 struct y_Error;
+struct y_ThreadRefs;
+struct y_ClassDesc;
+
+/**
+ * The slot of a class in the type table of each runtime.  A class keeps its 
+ * slot in a static variable, initialised to 0: the slot is assigned the first 
+ * time the class is initialised in any runtime, and is the same in all of 
+ * them, whereas each runtime has its own class structure.
+ */
+typedef atomic_int y_TypeSlot;
 
 /**
  * Create a Runtime, or aquire an existing one.
@@ -44,7 +54,8 @@ struct y_Error;
  * If NULL, a new pool will be created from the global pool.
  * @param  pool_buffer_size  The number of pools to keep buffered for reuse.
  * @param  threadsafe  Whether thread safety is to be enforced (using mutexes 
- * for unsafe operations).
+ * for unsafe operations).  Ignored in the single-threaded variant (see @ref 
+ * y_HAS_THREADS).
  * @return  The Runtime.
  */
 y_Runtime * y_Runtime_new (apr_pool_t * global_pool,
@@ -53,11 +64,14 @@ y_Runtime * y_Runtime_new (apr_pool_t * global_pool,
 /**
  * Initialise a new type in the Yakka type system.
  *
- * This method is thread-safe, and can accommodate race conditions.  Before 
- * initialising the type, the Runtime is locked and an attempt is made to get 
- * the type, just in case another thread has already created the type.  If 
- * found, the existing type will be returned.  If not, the type will be created 
- * and stored in the runtime in the locked section of code.
+ * This method is thread-safe, and can accommodate race conditions.  Each type 
+ * is initialised once per runtime: the first thread to claim its slot (under 
+ * the runtime lock) initialises it, and other threads wanting the same type 
+ * wait until it is published.  The initialisation itself runs without the 
+ * runtime lock in a threadsafe runtime, so that unrelated types may be 
+ * initialised in parallel.  A type must not need itself (directly or through 
+ * other types) to be initialised: if threads initialising types end up waiting 
+ * on each other, the one that would close the cycle gets NULL instead.
  *
  * This method only handles the general steps of type initialisation.  An 
  * init_type callback is to be provided by the caller.  That callback will 
@@ -66,50 +80,112 @@ y_Runtime * y_Runtime_new (apr_pool_t * global_pool,
  *
  * @param  rt  The Runtime that is to create and store the type.
  * @param  type_name  The name under which the type will be stored (and 
- * retrieved later).
+ * retrieved later, see @ref y_Runtime_find_type).
  * @param  type_size  The size, in bytes, to be allocated for the type struct.
  * @param  super_type  The super type of the type being created (or NULL if the 
  * type has no super type, but this would be uncommon).
  * @param  init_type  The callback to be used to complete the class-specific 
  * initialisation of the type.
- * @param  type_location  The location in memory where the type is to be stored.
- * @return  The initialised class type.
+ * @param  type_slot  The slot of the type (see @ref y_TypeSlot).
+ * @return  The initialised class type (NULL if it did not exist and the 
+ * runtime is sealed, if the super type is final, if waiting for it would 
+ * deadlock, or if there was no memory for its initialisation).
  */
 void * y_Runtime_init_type (y_Runtime * rt, const char * type_name,
         int type_size, void * super_type,
         void (* init_type) (y_Runtime * rt, void * type, void * super_type),
-        void ** type_location);
+        y_TypeSlot * type_slot);
+
+/**
+ * Initialise a class from its class descriptor (see @ref y_DEFINE_CLASS), if 
+ * it hasn't been already, as @ref y_Runtime_init_type does.
+ *
+ * @param  rt  The Yakka runtime.
+ * @param  desc  The class descriptor.
+ * @return  The class structure (NULL if it did not exist and the runtime is 
+ * sealed, or if the super class is final).
+ */
+void * y_Runtime_init_class (y_Runtime * rt, const struct y_ClassDesc * desc);
+
+/**
+ * Get a class structure of the runtime, without locking.
+ *
+ * @param  rt  The Yakka runtime.
+ * @param  type_slot  The slot of the class.
+ * @return  The class structure, or NULL if the class has not been initialised 
+ * in this runtime.
+ */
+void * y_Runtime_get_type (y_Runtime * rt, y_TypeSlot * type_slot);
+
+/**
+ * Find a class structure of the runtime by name, without locking.  Only the 
+ * classes that have been initialised in the runtime can be found (see also 
+ * @ref y_REGISTER_CLASSES); if several have the same name, the first one 
+ * keeps it.
+ *
+ * @param  rt  The Yakka runtime.
+ * @param  type_name  The name of the class (or NULL).
+ * @return  The class structure, or NULL if there is no such class.
+ */
+void * y_Runtime_find_type (y_Runtime * rt, const char * type_name);
+
+/**
+ * Find the numeric identifier of a class of the runtime by name, without 
+ * locking (see @ref y_Runtime_find_type).  The identifier is the slot of the 
+ * class, so it is the same in every runtime: it may be looked up once, and 
+ * the class then retrieved with @ref y_Runtime_get_type_by_id, without 
+ * hashing its name.
+ *
+ * @param  rt  The Yakka runtime.
+ * @param  type_name  The name of the class (or NULL).
+ * @return  The identifier, or 0 if there is no such class.
+ */
+int y_Runtime_find_type_id (y_Runtime * rt, const char * type_name);
+
+/**
+ * Get a class structure of the runtime by numeric identifier (see @ref 
+ * y_Runtime_find_type_id), without locking.
+ *
+ * @param  rt  The Yakka runtime.
+ * @param  type_id  The identifier of the class.
+ * @return  The class structure, or NULL if there is no such class.
+ */
+void * y_Runtime_get_type_by_id (y_Runtime * rt, int type_id);
 
 /**
  * Convenience macro: get or initialise a subtype.
  
- * This macro generates code that first searches for the class identified by 
- * name.  If found, it is returned.  Otherwise the type is initialised and 
- * returned.
+ * This macro generates code that first searches the runtime for the class in 
+ * the given slot.  If found, it is returned.  Otherwise the type is 
+ * initialised and returned.  The search takes no lock: it is three acquire 
+ * loads (of the slot, the type table and the table entry), each paired with 
+ * the release that published it, so a class found this way is fully 
+ * initialised.
  *
  * @param  rt  Pointer to the runtime.
  * @param  type_name  Name of the class, as a cstring.
  * @param  Class  The class' struct.
  * @param  get_super  Method to get the super type.
  * @param  type_init  Class initialisation method.
- * @param  type  The name of the variable to which the class stucture will be 
- * assigned.
+ * @param  type  The name of the (static) @ref y_TypeSlot variable of the 
+ * class.
  * @return  The type identified by type_name.
  */
 #define y_GET_OR_CREATE_SUBTYPE(rt, type_name, Class, get_super, type_init,     \
         type)                                               \
     do {                                                    \
-        if ( ! type ) {                                     \
-            type = y_Runtime_init_type(                     \
+        void * found_type = y_Runtime_get_type (rt, & type);\
+        if ( ! found_type ) {                               \
+            found_type = y_Runtime_init_type(               \
                     rt,                                     \
                     type_name,                              \
                     sizeof (Class),                         \
                     get_super (rt),                         \
                     type_init,                              \
-                    (void **)& type                         \
+                    & type                                  \
                     );                                      \
         }                                                   \
-        return (Class *)type;                               \
+        return (Class *)found_type;                         \
     } while (0)
 
 /**
@@ -120,8 +196,35 @@ void * y_Runtime_init_type (y_Runtime * rt, const char * type_name,
  */
 bool y_Runtime_is_threadsafe (y_Runtime * rt);
 
+/**
+ * Seal the runtime once startup is over: no types or interfaces may be 
+ * registered after this.  The classes and interface identifiers that exist 
+ * are kept and remain usable, and looking them up never takes the runtime's 
+ * lock; creating an instance of a class that was not registered in time fails 
+ * with a @ref y_Error, and an unknown interface name gets the identifier 0 
+ * (which no class implements).
+ *
+ * The classes of the library itself (Object, Error and WeakRef) are 
+ * registered first, so that errors can still be reported.
+ *
+ * @param  rt  The Yakka runtime.
+ */
+void y_Runtime_seal (y_Runtime * rt);
+
+/**
+ * Enquire: has the runtime been sealed (see @ref y_Runtime_seal)?
+ *
+ * @param  rt  The Yakka runtime.
+ */
+bool y_Runtime_is_sealed (y_Runtime * rt);
+
 /**
  * Get the Yakka runtime's global pool.
+ *
+ * While a class is being initialised (see @ref y_Runtime_init_type), this 
+ * returns a pool private to the initialising thread instead, which lives as 
+ * long as the global pool: the initialisation runs without the runtime lock, 
+ * and an APR pool must not be used by several threads at once.
  */
 apr_pool_t * y_Runtime_get_global_pool (y_Runtime * rt);
 
@@ -137,21 +240,163 @@ apr_pool_t * y_Runtime_create_object_pool (y_Runtime * rt,
 void y_Runtime_free_object_pool (y_Runtime * rt, apr_pool_t * pool);
 
 /**
- * Get the identifier of an interface, by name.
+ * Get the identifier of an interface, by name, registering the name if it is 
+ * new.
+ *
+ * Looking up a registered name takes no lock, and is never blocked by the 
+ * registration of other names.
  */
 int y_Runtime_get_interface_id (y_Runtime * rt, const char * name);
 
+/**
+ * Register an interface by its descriptor (@ref y_DEFINE_INTERFACE), assigning 
+ * its identifier if it doesn't have one yet in this runtime.  The identifier 
+ * is cached by the runtime, so that later registrations of the descriptor 
+ * neither take a lock nor look up its name.
+ *
+ * A sealed runtime (see @ref y_Runtime_seal) only has room for the 
+ * descriptors that were registered with some runtime before it was sealed; 
+ * the identifiers of the others are looked up by name every time.
+ *
+ * @return  The identifier of the interface (0 if it is not registered and the 
+ * runtime is sealed).
+ */
+int y_Runtime_register_interface (y_Runtime * rt, y_InterfaceDesc * desc);
+
+/**
+ * Get the identifier cached for an interface descriptor by @ref 
+ * y_Runtime_register_interface, without registering it.  Takes no lock.
+ *
+ * @return  The identifier of the interface, or 0 if the descriptor has not 
+ * been registered with this runtime.
+ */
+int y_Runtime_find_interface (y_Runtime * rt, const y_InterfaceDesc * desc);
+
+/**
+ * Register an array of interface descriptors, such as the linker section of a 
+ * module (see @ref y_REGISTER_INTERFACES).  Interfaces not yet known to the 
+ * runtime are assigned consecutive identifiers.
+ *
+ * @param  start  The first descriptor (may be NULL if there are none).
+ * @param  end  The end of the array.
+ */
+void y_Runtime_register_interfaces (y_Runtime * rt,
+        y_InterfaceDesc * const * start, y_InterfaceDesc * const * end);
+
+/**
+ * Associate an inline cache (@ref y_InlineCache) with the runtime, so that it 
+ * is cleared when the runtime is destroyed, unless it is already associated 
+ * with another runtime.
+ *
+ * @return  True if the cache may be filled with the runtime's classes.
+ */
+bool y_Runtime_add_inline_cache (y_Runtime * rt, y_InlineCache * cache);
+
 /**
  * Create a packed set of interface implementations, using the provided 
  * interface specifications.
  *
  * The provided specs are in the form of a NULL-terminated list of 
  * specification name and implementation pairs.  These are re-arranged into a 
- * sparsely-populated array of implementations, indexed by interface ID.
+ * small hash table of implementations, keyed by interface ID (see @ref 
+ * y_Interfaces).  If an interface is specified more than once, the last 
+ * implementation is used.  Interfaces that are unknown to a sealed runtime 
+ * (see @ref y_Runtime_seal) are left out.
  */
 y_Interfaces * y_Runtime_pack_interfaces (y_Runtime * rt,
         y_InterfaceSpec * specs);
 
+/**
+ * Create a packed set of interface implementations from those of a super class 
+ * and the provided interface specifications, which add to or override them 
+ * (see @ref y_implement_interfaces).
+ *
+ * @param  inherited  The implementations of the super class (NULL if none).
+ * @param  specs  A NULL-terminated list of specifications (or NULL).
+ * @return  The merged implementations, or NULL if there are none.
+ */
+y_Interfaces * y_Runtime_merge_interfaces (y_Runtime * rt,
+        const y_Interfaces * inherited, y_InterfaceSpec * specs);
+
+/**
+ * Get the reference counting state of the current thread (see @ref 
+ * y_ThreadRefs), creating it if required.
+ *
+ * The state lives as long as the runtime.  When the thread exits, any objects 
+ * queued for it to merge are merged.
+ *
+ * @param  rt  The Yakka runtime.
+ * @return  The reference counting state of the current thread.  (If the 
+ * runtime is not threadsafe, there is only one.)
+ */
+struct y_ThreadRefs * y_Runtime_get_thread_refs (y_Runtime * rt);
+
+/**
+ * Release the objects created by the current thread that are no longer 
+ * referenced.
+ *
+ * Objects are reference counted with a bias towards the thread that created 
+ * them.  If other threads release the last references to an object, it is 
+ * only destroyed once the thread that created it merges the counts; that 
+ * happens whenever the thread creates an object, and when it exits.  A 
+ * long-lived thread that may stop creating objects (e.g. a worker between 
+ * requests) can call this method to release such objects promptly.  Objects 
+ * whose destruction was deferred by borrowing, and are no longer borrowed, are 
+ * destroyed too.
+ *
+ * @param  rt  The Yakka runtime.
+ */
+void y_Runtime_merge_refcounts (y_Runtime * rt);
+
+/**
+ * Open a borrow scope for the current thread (see @ref y_BORROW).
+ *
+ * Until the scope is closed, no object of the runtime that the thread could 
+ * have reached since it was opened is destroyed, even if it is released.  
+ * Scopes may be nested.
+ *
+ * @param  rt  The Yakka runtime.
+ */
+void y_Runtime_borrow_begin (y_Runtime * rt);
+
+/**
+ * Close a borrow scope of the current thread, opened by @ref 
+ * y_Runtime_borrow_begin.  When the outermost scope is closed, the objects 
+ * released while it was open are destroyed, unless other threads' scopes still 
+ * require them.
+ *
+ * @param  rt  The Yakka runtime.
+ */
+void y_Runtime_borrow_end (y_Runtime * rt);
+
+/**
+ * Defer the destruction of an object that is no longer referenced, if any 
+ * thread has a borrow scope open.
+ *
+ * @param  rt  The Yakka runtime.
+ * @param  self  An object whose last reference has been released.
+ * @return  True if the object will be destroyed when borrowing ends; false if 
+ * nothing is borrowed, and the caller must destroy the object.
+ */
+bool y_Runtime_defer_destroy (y_Runtime * rt, void * self);
+
+/**
+ * Count an occasion on which a thread had to wait for the lock of an object of 
+ * the runtime while locking several objects (see @ref y_lock_many).
+ *
+ * @param  rt  The Yakka runtime.
+ */
+void y_Runtime_count_lock_contention (y_Runtime * rt);
+
+/**
+ * Get the number of times threads have had to wait for locks while locking 
+ * several objects of the runtime at once (see @ref y_lock_many).
+ *
+ * @param  rt  The Yakka runtime.
+ * @return  The number of contended locks.
+ */
+unsigned long y_Runtime_get_lock_contention (y_Runtime * rt);
+
 /**
  * Lock the resource manager.
  */
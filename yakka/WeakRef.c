@@ -2,7 +2,7 @@
 #include "Object-protected.h"
 
 static char * weak_ref_type_name = "y_WeakRef";
-static y_WeakRefClass * weak_ref_class = NULL;
+static y_TypeSlot weak_ref_class = 0;
 
 y_WeakRef * y_WeakRef_new (y_Runtime * rt, void * instance,
         y_Error ** error)
@@ -65,7 +65,8 @@ y_WeakRef_init_type (y_Runtime * rt, void * type, void * super_type)
             sizeof (y_WeakRefProtected),
             NULL,  /* init */
             NULL,  /* assign */
-            NULL   /* clear */
+            NULL,  /* clear */
+            0      /* flags: inherited */
             );
 }
 